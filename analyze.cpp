@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "text_reader.h"
+#include "run_file.h"
+#include "statistics.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Snapshot of a text run: outputDir/stepN.dat
+struct StepFile {
+  int64_t step;
+  std::string path;
+};
+
+// Text snapshots of a run directory, sorted by step
+std::vector<StepFile> stepFiles(const fs::path& dir) {
+  static const std::regex pattern(R"(step(\d+)\.dat)");
+  std::vector<StepFile> files;
+  for (auto const& entry : fs::directory_iterator(dir)) {
+    std::smatch match;
+    std::string name = entry.path().filename().string();
+    if (entry.is_regular_file() && std::regex_match(name, match, pattern))
+      files.push_back({std::stoll(match[1]), entry.path().string()});
+  }
+  std::sort(files.begin(), files.end(), [](const StepFile& a, const StepFile& b) { return a.step < b.step; });
+  return files;
+}
+
+// The run directories under `dir`: dir itself if it holds snapshots, its subdirectories that do otherwise
+std::vector<fs::path> runDirectories(const fs::path& dir) {
+  if (!stepFiles(dir).empty())
+    return {dir};
+  std::vector<fs::path> runs;
+  for (auto const& entry : fs::directory_iterator(dir)) {
+    if (entry.is_directory() && !stepFiles(entry.path()).empty())
+      runs.push_back(entry.path());
+  }
+  std::sort(runs.begin(), runs.end());
+  return runs;
+}
+
+// Parameters encoded in the name of a run directory (stepSize=X_nWalkers=N[_h=H], under snap/ or nosnap/)
+std::map<std::string, std::string> runParameters(const fs::path& dir) {
+  std::map<std::string, std::string> parameters = {{"convertedFrom", dir.string()}};
+  std::smatch match;
+  std::string name = dir.filename().string();
+  if (std::regex_match(name, match, std::regex(R"(stepSize=([\d.e+-]+)_nWalkers=(\d+)(?:_h=([\d.e+-]+))?)"))) {
+    parameters["stepSize"] = match[1];
+    parameters["nWalkers"] = match[2];
+    if (match[3].matched)
+      parameters["h"] = match[3];
+  }
+  std::string parent = dir.parent_path().filename().string();
+  if (parent == "snap" || parent == "nosnap")
+    parameters["snap"] = parent == "snap" ? "1" : "0";
+  return parameters;
+}
+
+// Snapshots parsed together: bounds the memory used while keeping all the threads busy
+constexpr size_t BATCH_FILES = 64;
+
+/**
+ * @brief Computes the variance curve of a text run and optionally converts it to a run file.
+ *
+ * Snapshots are parsed in batches, the files of a batch in parallel (or, for runs with few large files, each file
+ * split across the threads); the variance table and the run file are then written in step order.
+ */
+void analyzeRun(const fs::path& dir, Point start, Point centre, bool convert) {
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<StepFile> files = stepFiles(dir);
+  // strip a trailing separator, so that data/run/ writes data/run_variance.csv and not data/run/_variance.csv
+  std::string run = (dir / "").parent_path().string();
+
+  StepTable table(run + "_variance.csv", {"variance"});
+  std::unique_ptr<RunFileWriter> runFile;
+  if (convert) {
+    runFile = std::make_unique<RunFileWriter>(run + ".rwrun");
+    runFile->writeParameters(runParameters(dir));
+  }
+
+  int nThreads = 1;
+#ifdef _OPENMP
+  nThreads = omp_get_max_threads();
+#endif
+  bool filesInParallel = files.size() >= size_t(nThreads);
+
+  size_t nPoints = 0;
+  for (size_t first = 0; first < files.size(); first += BATCH_FILES) {
+    size_t count = std::min(BATCH_FILES, files.size() - first);
+    std::vector<std::vector<Point>> snapshots(count);
+    std::vector<double> variances(count);
+    std::vector<std::string> errors(count);
+
+    // exceptions cannot leave the parallel region: keep the messages and rethrow after it
+    #pragma omp parallel for schedule(dynamic, 1) if(filesInParallel)
+    for (size_t i = 0; i < count; ++i) {
+      try {
+        snapshots[i] = readPointsText(files[first + i].path, !filesInParallel);
+        variances[i] = geodesicVariance(snapshots[i].data(), snapshots[i].size(), start, centre);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      if (!errors[i].empty())
+        throw std::runtime_error(errors[i]);
+      table.write(files[first + i].step, {variances[i]});
+      if (runFile)
+        runFile->writeSnapshot(files[first + i].step, snapshots[i].data(), snapshots[i].size());
+      nPoints += snapshots[i].size();
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << run << ": " << files.size() << " snapshots, " << nPoints << " points in " << seconds << " s.\n";
+}
+
+
+// Default parameters: those of variance() in data_analysis.py
+Point START = {9.5, 5, 5};
+Point CENTRE = {0, 0, 0};
+bool CONVERT = false;
+
+int main(int argc, char** argv) {
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      std::cout << "Usage: " << argv[0] << " [options] DIR...\n";
+      std::cout << "  DIR: a run directory with stepN.dat snapshots, or a directory of runs (e.g. data/nosnap)\n";
+      std::cout << "Writes the geodesic variance of each snapshot to <run>_variance.csv (same math as variance()\n";
+      std::cout << "in data_analysis.py).\n";
+      std::cout << "Options:\n";
+      std::cout << "  --start X Y Z     Starting point of the walkers (default: 9.5 5 5)\n";
+      std::cout << "  --centre X Y Z    Centre used for geodesic angles (default: 0 0 0 as data_analysis.py;\n";
+      std::cout << "                    5 5 5 gives the in-situ --variance of rwalk-surface)\n";
+      std::cout << "  --convert         Also write all the snapshots of each run to <run>.rwrun\n";
+      return 0;
+    }
+    if (arg == "--start" && i + 3 < argc) {
+      START.x = std::stod(argv[++i]);
+      START.y = std::stod(argv[++i]);
+      START.z = std::stod(argv[++i]);
+    }
+    else if (arg == "--centre" && i + 3 < argc) {
+      CENTRE.x = std::stod(argv[++i]);
+      CENTRE.y = std::stod(argv[++i]);
+      CENTRE.z = std::stod(argv[++i]);
+    }
+    else if (arg == "--convert") CONVERT = true;
+    else args.push_back(arg);
+  }
+  if (args.empty()) {
+    std::cerr << "Usage: " << argv[0] << " [options] DIR... (--help for details)\n";
+    return 1;
+  }
+
+  for (auto const& arg : args) {
+    std::vector<fs::path> runs = runDirectories(arg);
+    if (runs.empty())
+      std::cerr << "No stepN.dat snapshots in " << arg << ".\n";
+    for (auto const& run : runs)
+      analyzeRun(run, START, CENTRE, CONVERT);
+  }
+  return 0;
+}
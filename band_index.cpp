@@ -0,0 +1,86 @@
+#include "band_index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+BandIndex::BandIndex(const Surface &surf) :
+                _h{surf.h()} {
+  if (_h == 0) {
+    throw std::runtime_error("BandIndex: the surface needs to be constructed using a function to have a lattice.");
+  }
+  std::array<long,3> lo = {std::numeric_limits<long>::max(), std::numeric_limits<long>::max(),
+                            std::numeric_limits<long>::max()};
+  std::array<long,3> hi = {std::numeric_limits<long>::min(), std::numeric_limits<long>::min(),
+                            std::numeric_limits<long>::min()};
+  for (int n = 0; n < surf.nPoints(); ++n) {
+    Point p = surf[n];
+    long i = std::lround(p.x/_h), j = std::lround(p.y/_h), k = std::lround(p.z/_h);
+    // the first point of a lattice point keeps it
+    if (_grid.get(i, j, k) < 0) {
+      _grid.set(i, j, k, n);
+      ++_size;
+    }
+    lo = {std::min(lo[0], i), std::min(lo[1], j), std::min(lo[2], k)};
+    hi = {std::max(hi[0], i), std::max(hi[1], j), std::max(hi[2], k)};
+  }
+
+  _occupancy = Occupancy(lo, hi);
+  for (int n = 0; n < surf.nPoints(); ++n) {
+    Point p = surf[n];
+    _occupancy.set(std::lround(p.x/_h), std::lround(p.y/_h), std::lround(p.z/_h));
+  }
+}
+
+int BandIndex::find(Point p) const {
+  return find(std::lround(p.x/_h), std::lround(p.y/_h), std::lround(p.z/_h));
+}
+
+int BandIndex::find(long i, long j, long k) const {
+  return _grid.get(i, j, k);
+}
+
+int BandIndex::nearest(Point p, int maxRadius) const {
+  double u = p.x/_h, v = p.y/_h, w = p.z/_h;
+  if (!std::isfinite(u) || !std::isfinite(v) || !std::isfinite(w))
+    return -1;
+  std::array<long,3> point{};
+  // between points at the same distance, the lowest index (as a search over the band points in order)
+  auto lowerIndex = [this](const std::array<long,3>& a, const std::array<long,3>& b) {
+    return find(a[0], a[1], a[2]) < find(b[0], b[1], b[2]);
+  };
+  if (!_occupancy.nearest(u, v, w, maxRadius, point, lowerIndex))
+    return -1;
+  return find(point[0], point[1], point[2]);
+}
+
+std::vector<std::array<int,3>> BandIndex::stencil(int maxNorm2) {
+  std::vector<std::array<int,3>> offsets = {{1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}};
+  for (int norm2 = 2; norm2 <= std::min(maxNorm2, 3); ++norm2) {
+    for (int i = -1; i <= 1; ++i) {
+      for (int j = -1; j <= 1; ++j) {
+        for (int k = -1; k <= 1; ++k) {
+          if (i*i + j*j + k*k == norm2)
+            offsets.push_back({i, j, k});
+        }
+      }
+    }
+  }
+  return offsets;
+}
+
+std::vector<int> BandIndex::neighbours(const Surface &surf, int maxNorm2) const {
+  std::vector<std::array<int,3>> offsets = stencil(maxNorm2);
+  size_t nOffsets = offsets.size();
+
+  std::vector<int> result(nOffsets*size_t(surf.nPoints()));
+  #pragma omp parallel for schedule(static)
+  for (int n = 0; n < surf.nPoints(); ++n) {
+    Point p = surf[n];
+    long i = std::lround(p.x/_h), j = std::lround(p.y/_h), k = std::lround(p.z/_h);
+    for (size_t d = 0; d < nOffsets; ++d) {
+      result[nOffsets*n + d] = find(i + offsets[d][0], j + offsets[d][1], k + offsets[d][2]);
+    }
+  }
+  return result;
+}
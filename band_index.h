@@ -0,0 +1,58 @@
+#ifndef BAND_INDEX_H
+#define BAND_INDEX_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "occupancy.h"
+#include "sparse_grid.h"
+#include "surface.h"
+
+/**
+ * @brief Maps the lattice points of a Surface band to their index in the surface.
+ *
+ * Band points built by the implicit constructor lie on the lattice of spacing h (the same lattice Surface::snap
+ * rounds to), so each point is identified by its integer coordinates round(x/h), round(y/h), round(z/h), each in
+ * [-2^20, 2^20). The indices are stored in a SparseGrid: only the 8^3 bricks of the lattice touching the band.
+ * An Occupancy bitset over the bounding box of the band answers membership queries with a single bit test.
+ */
+class BandIndex {
+  double _h;
+  SparseGrid _grid;
+  Occupancy _occupancy;
+  size_t _size = 0;
+
+ public:
+  BandIndex(const Surface& surf);
+
+  // Index of the band point at the lattice point nearest to p, -1 if that lattice point is not in the band
+  int find(Point p) const;
+
+  // Index of the band point at lattice coordinates (i,j,k), -1 if not in the band
+  int find(long i, long j, long k) const;
+
+  // Whether the lattice point (i,j,k) is in the band, without branches
+  bool contains(long i, long j, long k) const { return _occupancy.contains(i, j, k); };
+
+  // Index of the band point nearest to p among those within maxRadius lattice points of it, -1 if there are none
+  int nearest(Point p, int maxRadius) const;
+
+  // Lattice offsets (i,j,k) != 0 with i^2+j^2+k^2 <= maxNorm2: 6 faces for 1, plus 12 edges for 2, plus 8 corners for 3
+  static std::vector<std::array<int,3>> stencil(int maxNorm2);
+
+  /**
+   * @brief Lattice neighbours of every band point of `surf` (the surface this index was built from).
+   *
+   * Returns stencil(maxNorm2).size() indices per point, in stencil order (for maxNorm2 = 1: +x, -x, +y, -y, +z, -z);
+   * -1 where the neighbour is not in the band.
+   */
+  std::vector<int> neighbours(const Surface& surf, int maxNorm2 = 1) const;
+
+  double h() const { return _h; };
+  size_t size() const { return _size; };
+  const SparseGrid& grid() const { return _grid; };
+  const Occupancy& occupancy() const { return _occupancy; };
+};
+
+#endif  //BAND_INDEX_H
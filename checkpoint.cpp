@@ -0,0 +1,148 @@
+#include "checkpoint.h"
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static constexpr char CHECKPOINT_MAGIC[8] = {'R','W','C','K','P','T','0','1'};
+
+template <typename T>
+static void writeValue(std::ofstream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T readValue(std::ifstream& in) {
+  T value{};
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+void saveCheckpoint(const std::string &filename, const Checkpoint &checkpoint) {
+  std::string tmp = filename + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("saveCheckpoint: cannot open " + tmp + ".");
+    }
+    out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    writeValue<double>(out, checkpoint.stepSize);
+    writeValue<int64_t>(out, checkpoint.nSteps);
+    writeValue<int64_t>(out, checkpoint.snap);
+    writeValue<int64_t>(out, checkpoint.nWalkers);
+    writeValue<Point>(out, checkpoint.startingPoint);
+    writeValue<int64_t>(out, checkpoint.step);
+    writeValue<uint64_t>(out, checkpoint.rngState.size());
+    out.write(checkpoint.rngState.data(), checkpoint.rngState.size());
+    writeValue<uint64_t>(out, checkpoint.walkers.size());
+    out.write(reinterpret_cast<const char*>(checkpoint.walkers.data()), checkpoint.walkers.size()*sizeof(Point));
+    out.flush();
+    if (!out) {
+      throw std::runtime_error("saveCheckpoint: write to " + tmp + " failed.");
+    }
+  }
+  std::filesystem::rename(tmp, filename);
+}
+
+Checkpoint loadCheckpoint(const std::string &filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("loadCheckpoint: cannot open " + filename + ".");
+  }
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  in.read(magic, sizeof(magic));
+  if (!in || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+    throw std::runtime_error("loadCheckpoint: " + filename + " is not a checkpoint.");
+  }
+
+  Checkpoint checkpoint;
+  checkpoint.stepSize = readValue<double>(in);
+  checkpoint.nSteps = readValue<int64_t>(in);
+  checkpoint.snap = readValue<int64_t>(in);
+  checkpoint.nWalkers = readValue<int64_t>(in);
+  checkpoint.startingPoint = readValue<Point>(in);
+  checkpoint.step = readValue<int64_t>(in);
+  checkpoint.rngState.resize(readValue<uint64_t>(in));
+  in.read(checkpoint.rngState.data(), checkpoint.rngState.size());
+  checkpoint.walkers.resize(readValue<uint64_t>(in));
+  in.read(reinterpret_cast<char*>(checkpoint.walkers.data()), checkpoint.walkers.size()*sizeof(Point));
+  if (!in) {
+    throw std::runtime_error("loadCheckpoint: " + filename + " is truncated.");
+  }
+  return checkpoint;
+}
+
+
+CheckpointWriter::CheckpointWriter(std::string filename) :
+                _filename{filename},
+                _thread{&CheckpointWriter::run, this} {
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+void CheckpointWriter::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _cv.wait(lock, [this] { return _pending || _stop; });
+    if (!_pending)
+      return;   // stopped with nothing left to write
+
+    std::unique_ptr<Checkpoint> checkpoint = std::move(_pending);
+    _busy = true;
+    lock.unlock();
+    std::string error;
+    try {
+      saveCheckpoint(_filename, *checkpoint);
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    lock.lock();
+    _busy = false;
+    if (!error.empty())
+      _error = error;
+    _cv.notify_all();
+  }
+}
+
+void CheckpointWriter::submit(Checkpoint checkpoint) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending = std::make_unique<Checkpoint>(std::move(checkpoint));
+  }
+  _cv.notify_all();
+}
+
+void CheckpointWriter::flush() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait(lock, [this] { return !_pending && !_busy; });
+  if (!_error.empty()) {
+    std::string error = _error;
+    _error.clear();
+    throw std::runtime_error("CheckpointWriter: " + error);
+  }
+}
+
+
+static volatile std::sig_atomic_t stopSignal = 0;
+
+static void onStopSignal(int signal) {
+  stopSignal = signal;
+}
+
+void installStopHandlers() {
+  std::signal(SIGTERM, onStopSignal);
+  std::signal(SIGINT, onStopSignal);
+}
+
+bool stopRequested() {
+  return stopSignal != 0;
+}
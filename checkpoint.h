@@ -0,0 +1,80 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils.hpp"
+
+// State needed to continue a simulation exactly where it stopped
+struct Checkpoint {
+  // parameters of the run, checked when resuming
+  double stepSize = 0;
+  int nSteps = 0;
+  bool snap = false;
+  int nWalkers = 0;
+  Point startingPoint;
+
+  int step = 0;               // next step to simulate: equal to nSteps once the run is completed
+  std::string rngState;       // engine and distribution, as written by their operator<<
+  std::vector<Point> walkers;
+};
+
+/**
+ * @brief Writes `checkpoint` to `filename` in binary form.
+ *
+ * The data is written to `filename`.tmp and renamed over `filename`, so a crash while writing never leaves a
+ * corrupted checkpoint behind: the previous one survives.
+ */
+void saveCheckpoint(const std::string& filename, const Checkpoint& checkpoint);
+
+// Reads a checkpoint written by saveCheckpoint. Throws std::runtime_error if the file is missing or invalid
+Checkpoint loadCheckpoint(const std::string& filename);
+
+/**
+ * @brief Writes checkpoints from a background thread, so that the walker loop only pays for a copy of the state.
+ *
+ * If a new checkpoint is submitted while the previous one is still waiting to be written, the older one is dropped.
+ */
+class CheckpointWriter {
+  std::string _filename;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::unique_ptr<Checkpoint> _pending;
+  bool _busy = false;
+  bool _stop = false;
+  std::string _error;
+  std::thread _thread;
+
+  void run();
+
+ public:
+  CheckpointWriter(std::string filename);
+  CheckpointWriter(const CheckpointWriter &src) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter &src) = delete;
+  ~CheckpointWriter();                  // writes the pending checkpoint, if any, and joins the thread
+
+  const std::string& filename() const { return _filename; };
+
+  // Queue `checkpoint` for writing and return immediately
+  void submit(Checkpoint checkpoint);
+
+  // Wait until every submitted checkpoint is on disk. Throws if a write failed
+  void flush();
+};
+
+/**
+ * @brief Installs handlers for SIGTERM and SIGINT that only raise a flag, checked by the simulation loop.
+ *
+ * The loop then writes a checkpoint synchronously and stops cleanly, instead of dying mid-write.
+ */
+void installStopHandlers();
+
+// True once SIGTERM or SIGINT has been received
+bool stopRequested();
+
+#endif  //CHECKPOINT_H
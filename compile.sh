@@ -1 +1,2 @@
-g++ main.cpp surface.cpp -o rwalk-surface.out -O3 -std=c++17
\ No newline at end of file
+g++ main.cpp surface.cpp snapshot_ring.cpp text_writer.cpp run_file.cpp checkpoint.cpp log_schedule.cpp statistics.cpp band_index.cpp density_map.cpp geodesic.cpp sparse.cpp heat_method.cpp manifest.cpp simulation.cpp sweep.cpp result_cache.cpp surface_cache.cpp mapped_file.cpp point_arrays.cpp spatial_sort.cpp sparse_grid.cpp occupancy.cpp -o rwalk-surface.out -O3 -std=c++17 -fopenmp
+g++ analyze.cpp text_reader.cpp run_file.cpp statistics.cpp -o rwalk-analyze.out -O3 -std=c++17 -fopenmp
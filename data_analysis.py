@@ -1,5 +1,10 @@
 import numpy as np
 import argparse
+import json
+import os
+import mmap
+import struct
+import time
 
 def geodesic_distance(a, b, radius=4.5, output='rad'):
     """
@@ -45,10 +50,26 @@ def geodesic_distance(a, b, radius=4.5, output='rad'):
     else:
         raise ValueError("Invalid output type. Choose from 'rad', 'deg', or 'arc'.")
 
-def geodesic_distances(points, starting_point=(9.5, 5, 5), radius=4.5, output='rad'):
+# Rows processed at a time: bounds the temporaries of the vectorized code (a few MB) whatever the number of walkers
+CHUNK_SIZE = 1 << 16
+
+def _chunk_angles(chunk, start_unit, out):
+    """Geodesic angles (radians) between the rows of `chunk` and the unit vector `start_unit`, written to `out`."""
+    unit = np.array(chunk, dtype=np.float64)  # the only copy of the chunk: memmapped input stays read-only
+    unit /= np.sqrt(np.einsum('ij,ij->i', unit, unit))[:, None]
+    dots = unit @ start_unit
+    np.clip(dots, -1.0, 1.0, out=dots)  # clip to avoid numerical issues
+    cross = np.cross(unit, start_unit)
+    np.arctan2(np.sqrt(np.einsum('ij,ij->i', cross, cross)), dots, out=out)
+    return out
+
+def geodesic_distances(points, starting_point=(9.5, 5, 5), radius=4.5, output='rad', chunk_size=CHUNK_SIZE):
     """
     Compute geodesic distances from a starting point to multiple points on a sphere (vectorized).
 
+    Points are processed `chunk_size` rows at a time, so besides the result only chunk-sized temporaries are
+    allocated; `points` can be a memory-mapped array (see load_snapshot) larger than the available memory.
+
     Parameters
     ----------
     points : array-like, shape (N, 3)
@@ -60,33 +81,30 @@ def geodesic_distances(points, starting_point=(9.5, 5, 5), radius=4.5, output='r
     output : {'rad', 'deg', 'arc'}, optional
         If 'rad', return distances in radians. If 'deg', return distances in degrees. 
         If 'arc', return arc lengths. Default is 'rad'.
+    chunk_size : int, optional
+        Number of points processed at a time.
 
     Returns
     -------
     distances : ndarray, shape (N,)
         Geodesic distances from the starting point to each point.
     """
-    points = np.asarray(points)
-    starting_point = np.asarray(starting_point)
-
-    points_unit = points / np.linalg.norm(points, axis=1)[:, None]
-    start_unit = starting_point / np.linalg.norm(starting_point)
+    if output not in ('rad', 'deg', 'arc'):
+        raise ValueError("Invalid output type. Choose from 'rad', 'deg', or 'arc'.")
+    if not hasattr(points, 'shape'):
+        points = np.asarray(points)
+    start_unit = np.asarray(starting_point, dtype=np.float64)
+    start_unit = start_unit / np.linalg.norm(start_unit)
 
-    # compute the dot products of each row of points_unit with start_unit, producing a 1D array
-    dots = np.einsum('ij,j->i', points_unit, start_unit)
-    dots = np.clip(dots, -1.0, 1.0)  # clip to avoid numerical issues
+    angles = np.empty(len(points))
+    for first in range(0, len(points), chunk_size):
+        _chunk_angles(points[first:first + chunk_size], start_unit, angles[first:first + chunk_size])
 
-    cross_norms = np.linalg.norm(np.cross(points_unit, start_unit), axis=1)
-    angles = np.arctan2(cross_norms, dots)  # radians
-    
     if output == 'deg':
-        return np.degrees(angles)
+        np.degrees(angles, out=angles)
     elif output == 'arc':
-        return radius * angles
-    elif output == 'rad':
-        return angles
-    else:
-        raise ValueError("Invalid output type. Choose from 'rad', 'deg', or 'arc'.")
+        angles *= radius
+    return angles
 
 def test_geodesic_distance():
     # Check that both functions give the same result
@@ -109,20 +127,404 @@ def test_geodesic_distance():
     print(f"variance time: {time2:.4f} s")
     print(f"Max difference between methods: {np.max(np.abs(np.array(distances1) - distances2)):.30f}")
 
-def variance(final_positions, starting_point=(9.5, 5, 5), radius=4.5):
+def variance(final_positions, starting_point=(9.5, 5, 5), radius=4.5, chunk_size=CHUNK_SIZE):
     """
     Compute the variance of geodesic distances from a starting point to multiple final positions on a sphere.
+
+    The squared angles are summed chunk by chunk: peak memory depends on `chunk_size`, not on the number of walkers.
+    Raises ValueError if there are no positions.
     """
-    angles = geodesic_distances(final_positions, starting_point, radius=radius, output='rad')
-    var = np.mean(angles**2)
+    if not hasattr(final_positions, 'shape'):
+        final_positions = np.asarray(final_positions)
+    if len(final_positions) == 0:
+        raise ValueError("variance() needs at least one position.")
+    start_unit = np.asarray(starting_point, dtype=np.float64)
+    start_unit = start_unit / np.linalg.norm(start_unit)
+
+    angles = np.empty(min(chunk_size, len(final_positions)))
+    total = 0.0
+    for first in range(0, len(final_positions), chunk_size):
+        chunk = final_positions[first:first + chunk_size]
+        out = _chunk_angles(chunk, start_unit, angles[:len(chunk)])
+        total += np.dot(out, out)
+    var = total / len(final_positions)
     return var
 
+def load_snapshot(path, step=None):
+    """
+    Positions (n_walkers, 3) of a snapshot, memory-mapped when the format allows it.
+
+    Parameters
+    ----------
+    path : str
+        .npy file, .rwrun run file (the snapshot of `step`, the final positions if `step` is None) or text file
+        in the stepN.dat format (loaded in memory).
+    """
+    if path.endswith(".npy"):
+        return np.load(path, mmap_mode="r")
+    if path.endswith(".rwrun"):
+        run = RunFile(path)
+        return run.final_positions()[1] if step is None else run.read_step(step)
+    return np.loadtxt(path, ndmin=2)
+
+def _variance_task(task):
+    path, step, starting_point, radius, chunk_size = task
+    return variance(load_snapshot(path, step), starting_point, radius, chunk_size)
+
+def variances(snapshots, starting_point=(9.5, 5, 5), radius=4.5, chunk_size=CHUNK_SIZE, processes=None):
+    """
+    variance() of many snapshots in parallel, one snapshot per task of a process pool.
+
+    Parameters
+    ----------
+    snapshots : list
+        Paths accepted by load_snapshot, or (path, step) pairs for run files.
+    processes : int, optional
+        Number of worker processes (default: one per CPU); 1 computes everything in this process.
+
+    Returns
+    -------
+    ndarray, shape (len(snapshots),)
+
+    Example
+    -------
+    >>> run = RunFile(path)
+    >>> curve = variances([(path, s) for s in run.steps()])
+    """
+    tasks = [(s, None) if isinstance(s, str) else tuple(s) for s in snapshots]
+    tasks = [(path, step, tuple(starting_point), radius, chunk_size) for path, step in tasks]
+    if processes == 1 or len(tasks) < 2:
+        return np.array([_variance_task(t) for t in tasks])
+
+    from concurrent.futures import ProcessPoolExecutor
+    with ProcessPoolExecutor(max_workers=processes) as pool:
+        return np.array(list(pool.map(_variance_task, tasks)))
+
+MOMENT_QUANTITIES = ["x", "y", "z", "displacement", "squared_displacement", "angle", "squared_angle"]
+
+def load_moments(path):
+    """
+    Load the accumulator states written by `rwalk-surface.out --moments` (<run>_moments.bin).
+
+    Returns
+    -------
+    steps : ndarray, shape (S,)
+    states : ndarray, shape (S, Q, 5)
+        Raw state (n, mean, M2, M3, M4) of each quantity of MOMENT_QUANTITIES at each step.
+    """
+    with open(path, "rb") as f:
+        if f.read(8) != b"RWMOM001":
+            raise ValueError(f"{path} is not a moments file.")
+        n_quantities = struct.unpack("<Q", f.read(8))[0]
+        record = np.dtype([("step", "<i8"), ("state", "<f8", (n_quantities, 5))])
+        data = np.fromfile(f, dtype=record)
+    return data["step"], data["state"]
+
+def merge_moment_states(a, b):
+    """
+    Merge two arrays of accumulator states (..., 5) of disjoint samples (Chan et al. / Pebay formulas).
+    """
+    na, ma, m2a, m3a, m4a = np.moveaxis(a, -1, 0)
+    nb, mb, m2b, m3b, m4b = np.moveaxis(b, -1, 0)
+    n = na + nb
+    with np.errstate(invalid="ignore", divide="ignore"):
+        delta = mb - ma
+        mean = ma + delta * nb / n
+        m2 = m2a + m2b + delta**2 * na * nb / n
+        m3 = m3a + m3b + delta**3 * na * nb * (na - nb) / n**2 + 3 * delta * (na * m2b - nb * m2a) / n
+        m4 = (m4a + m4b + delta**4 * na * nb * (na**2 - na * nb + nb**2) / n**3
+              + 6 * delta**2 * (na**2 * m2b + nb**2 * m2a) / n**2 + 4 * delta * (na * m3b - nb * m3a) / n)
+    merged = np.stack([n, mean, m2, m3, m4], axis=-1)
+    return np.where((n == 0)[..., None], a, merged)
+
+def merge_moments(paths):
+    """
+    Merge the <run>_moments.bin files of independent runs (e.g. several processes or seeds) step by step.
+    Only the steps present in every file are kept.
+
+    Returns
+    -------
+    steps : ndarray, shape (S,)
+    summary : dict
+        For each quantity: dict of arrays 'n', 'mean', 'se', 'ci95', 'skewness', 'kurtosis' over the steps.
+    """
+    steps, states = load_moments(paths[0])
+    for path in paths[1:]:
+        other_steps, other_states = load_moments(path)
+        common, ia, ib = np.intersect1d(steps, other_steps, return_indices=True)
+        steps, states = common, merge_moment_states(states[ia], other_states[ib])
+    return steps, moment_summary(states)
+
+def moment_summary(states):
+    """Mean, standard error, 95% CI half width, skewness and excess kurtosis from accumulator states (S, Q, 5)."""
+    n, mean, m2, m3, m4 = np.moveaxis(states, -1, 0)
+    with np.errstate(invalid="ignore", divide="ignore"):
+        var = np.where(n > 1, m2 / (n - 1), 0.0)
+        se = np.sqrt(var / n)
+        skewness = np.where(m2 > 0, np.sqrt(n) * m3 / m2**1.5, 0.0)
+        kurtosis = np.where(m2 > 0, n * m4 / m2**2 - 3, 0.0)
+    return {name: {"n": n[:, q], "mean": mean[:, q], "se": se[:, q], "ci95": 1.96 * se[:, q],
+                   "skewness": skewness[:, q], "kurtosis": kurtosis[:, q]}
+            for q, name in enumerate(MOMENT_QUANTITIES)}
+
+def load_density(path):
+    """
+    Load the density histograms written by `rwalk-surface.out --density` (<run>_density.bin).
+
+    Returns
+    -------
+    steps : ndarray, shape (S,)
+    counts : ndarray
+        Sphere maps: shape (S, n_lat, n_lon), latitude bins uniform in sin(latitude) (equal area), longitude in
+        [-pi, pi). Band maps: shape (S, n_points), one count per band point.
+    info : dict
+        'kind' ('sphere' or 'band'); for spheres 'centre', 'lon_edges', 'lat_edges' (radians, ready for a Mollweide
+        pcolormesh); for bands 'points' (n_points, 3).
+    """
+    with open(path, "rb") as f:
+        magic, kind, _ = struct.unpack("<8sII", f.read(16))
+        if magic != b"RWDEN001":
+            raise ValueError(f"{path} is not a density file.")
+        if kind == 1:
+            n_lon, n_lat = struct.unpack("<QQ", f.read(16))
+            centre = np.frombuffer(f.read(24), dtype="<f8")
+            n_bins = n_lon * n_lat
+            info = {"kind": "sphere", "centre": centre,
+                    "lon_edges": np.linspace(-np.pi, np.pi, n_lon + 1),
+                    "lat_edges": np.arcsin(np.linspace(-1, 1, n_lat + 1))}
+            shape = (n_lat, n_lon)
+        else:
+            n_bins = struct.unpack("<Q", f.read(8))[0]
+            info = {"kind": "band", "points": np.frombuffer(f.read(24 * n_bins), dtype="<f8").reshape(-1, 3)}
+            shape = (n_bins,)
+        record = np.dtype([("step", "<i8"), ("counts", "<u4", (n_bins,))])
+        data = np.fromfile(f, dtype=record)
+    return data["step"], data["counts"].reshape((len(data),) + shape), info
+
+def load_manifest(path):
+    """
+    Load the manifest of a run written by rwalk-surface.out (<run>_manifest.json, see manifest.h).
+
+    The snapshot paths are made relative to the current directory; `manifest["steps"]` lists the logged steps
+    (without the final positions) in order.
+    """
+    with open(path) as f:
+        manifest = json.load(f)
+    root = os.path.dirname(path)
+    manifest["path"] = path
+    for snapshot in manifest["snapshots"]:
+        snapshot["file"] = os.path.join(root, snapshot["file"])
+    manifest["outputs"] = {name: os.path.join(root, file) for name, file in manifest["outputs"].items()}
+    manifest["steps"] = [s["step"] for s in manifest["snapshots"] if not s["final"]]
+    return manifest
+
+def find_runs(directory):
+    """
+    Manifests of all the runs in `directory` (e.g. data/nosnap), sorted by step size. Only the directory itself is
+    listed, never the snapshot directories of the runs.
+    """
+    paths = [os.path.join(directory, f) for f in os.listdir(directory) if f.endswith("_manifest.json")]
+    return sorted((load_manifest(p) for p in paths), key=lambda m: (m["parameters"]["stepSize"], m["path"]))
+
+def find_cached_runs(cache):
+    """
+    Manifests of the completed runs of a result cache (`rwalk-surface.out --cache DIR`), each with its cache key
+    under "key" (the canonical description of the run: surface, parameters, seed and output options).
+    """
+    runs = []
+    for entry in sorted(os.listdir(cache)):
+        marker = os.path.join(cache, entry, "complete")
+        if os.path.isfile(marker):
+            manifest = load_manifest(os.path.join(cache, entry, "run_manifest.json"))
+            with open(marker) as f:
+                manifest["key"] = f.read().strip()
+            runs.append(manifest)
+    return sorted(runs, key=lambda m: (m["parameters"]["stepSize"], m["path"]))
+
+def manifest_snapshot(manifest, step=None):
+    """
+    Positions (n_points, 3) of the snapshot of `step` described by `manifest` (the final positions if `step` is
+    None). Snapshots stored in run files are memory-mapped.
+    """
+    matches = [s for s in manifest["snapshots"] if (s["final"] if step is None else s["step"] == step and not s["final"])]
+    if not matches:
+        raise KeyError(f"{manifest['path']} has no snapshot for step {step}.")
+    snapshot = matches[0]
+    if manifest["format"] == "run":
+        return np.memmap(snapshot["file"], dtype="<f8", mode="r", offset=snapshot["offset"],
+                         shape=(snapshot["nPoints"], 3))
+    return np.loadtxt(snapshot["file"], ndmin=2)
+
+def manifest_sources(manifest):
+    """(steps, sources) of the logged snapshots of a run, the sources ready for variances()."""
+    snapshots = [s for s in manifest["snapshots"] if not s["final"]]
+    if manifest["format"] == "run":
+        return [s["step"] for s in snapshots], [(s["file"], s["step"]) for s in snapshots]
+    return [s["step"] for s in snapshots], [s["file"] for s in snapshots]
+
+class FrameOverwritten(RuntimeError):
+    """The requested frame of a LiveRing has been replaced by a newer one."""
+
+class LiveRing:
+    """
+    Read-only view of the shared memory snapshot ring published by `rwalk-surface.out --live-ring NAME`.
+
+    Frames are exposed as zero-copy numpy views into the shared memory segment. The writer may overwrite a slot
+    once `n_slots` newer frames have been published, so check `still_valid(token)` after using a frame (or copy it).
+
+    Example
+    -------
+    >>> ring = LiveRing("rwalk")
+    >>> step, positions, token = ring.latest()
+    >>> lon, lat = to_longlat(positions.T)  # plot...
+    >>> ring.still_valid(token)
+    """
+    MAGIC = b"RWRING01"
+    _HEADER = struct.Struct("<8sIIQQQQ")  # magic, version, n_slots, n_walkers, slot_bytes, data_offset, published
+    _SLOT = struct.Struct("<QqQQ")        # seq, step, n_walkers, reserved
+
+    def __init__(self, name, path="/dev/shm"):
+        with open(f"{path}/{name.lstrip('/')}", "rb") as f:
+            self._mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, self.n_slots, self.n_walkers, self._slot_bytes, self._data_offset, _ = self._HEADER.unpack_from(self._mm, 0)
+        if magic != self.MAGIC:
+            raise ValueError("Not a snapshot ring (or the writer is still initialising it).")
+        self._published_offset = self._HEADER.size - 8
+
+    def published(self):
+        """Number of frames published so far."""
+        return struct.unpack_from("<Q", self._mm, self._published_offset)[0]
+
+    def _seq(self, slot):
+        return struct.unpack_from("<Q", self._mm, self._data_offset + slot * self._slot_bytes)[0]
+
+    def frame(self, index):
+        """
+        Return (step, positions, token) for the frame number `index` (0 is the first frame ever published).
+        `positions` is an (n, 3) view on shared memory, valid as long as `still_valid(token)` is True.
+        Raises FrameOverwritten if the ring no longer holds the frame (only the last `n_slots` frames are kept).
+        """
+        published = self.published()
+        if not 0 <= index < published:
+            raise IndexError(f"Frame {index} has not been published ({published} frames so far).")
+        slot = index % self.n_slots
+        base = self._data_offset + slot * self._slot_bytes
+        # each write of a slot adds 2 to its sequence number: frame `index` is the (index // n_slots + 1)-th one
+        expected = 2 * (index // self.n_slots + 1)
+        seq, step, n, _ = self._SLOT.unpack_from(self._mm, base)
+        if seq == expected:
+            positions = np.frombuffer(self._mm, dtype="<f8", count=3 * n, offset=base + self._SLOT.size).reshape(n, 3)
+            if self._seq(slot) == seq:
+                return step, positions, (slot, seq)
+        raise FrameOverwritten(f"Frame {index} was overwritten, the ring only keeps the last {self.n_slots} frames.")
+
+    def latest(self, retries=100, wait=1e-3):
+        """Return (step, positions, token) of the most recently published frame."""
+        for _ in range(retries):
+            published = self.published()
+            if published == 0:
+                raise RuntimeError("No frame has been published yet.")
+            try:
+                return self.frame(published - 1)
+            except FrameOverwritten:
+                time.sleep(wait)    # the writer is replacing it: let it finish
+        raise RuntimeError("Could not read a consistent frame, the writer is too fast for the ring size.")
+
+    def still_valid(self, token):
+        """True if the frame identified by `token` has not been overwritten since it was read."""
+        slot, seq = token
+        return self._seq(slot) == seq
+
+    def close(self):
+        self._mm.close()
+
+class RunFile:
+    """
+    Reader for the single-file run container written by `rwalk-surface.out --format run` (see run_file.h).
+
+    Snapshots are returned as (n_walkers, 3) memory-mapped arrays, so any step can be accessed without reading
+    the rest of the file. Files whose writer was interrupted have no trailing index: it is rebuilt by walking
+    the records.
+
+    Example
+    -------
+    >>> run = RunFile("data/snap/stepSize=0.5_nWalkers=10000.rwrun")
+    >>> variances = [variance(run.read_step(s)) for s in run.steps()]
+    """
+    MAGIC = b"RWRUN001"
+    INDEX_MAGIC = b"RWRUNIDX"
+    SNAPSHOT, FINAL, PARAMETERS = 1, 2, 3
+    _HEADER_SIZE = 16
+    _RECORD = struct.Struct("<IIqQ")  # kind, reserved, step, n_items
+    _INDEX = np.dtype([("kind", "<u4"), ("reserved", "<u4"), ("step", "<i8"), ("offset", "<u8"), ("n_items", "<u8")])
+    _FOOTER = struct.Struct("<QQ8s")  # index offset, count, magic
+
+    def __init__(self, path):
+        self.path = path
+        self._data = np.memmap(path, dtype=np.uint8, mode="r")
+        if bytes(self._data[:8]) != self.MAGIC:
+            raise ValueError(f"{path} is not a run file.")
+
+        size = len(self._data)
+        self.complete = False
+        if size >= self._HEADER_SIZE + self._FOOTER.size:
+            index_offset, count, magic = self._FOOTER.unpack(bytes(self._data[size - self._FOOTER.size:]))
+            if magic == self.INDEX_MAGIC and index_offset + count * self._INDEX.itemsize + self._FOOTER.size == size:
+                self.index = np.frombuffer(self._data, dtype=self._INDEX, count=count, offset=index_offset)
+                self.complete = True
+        if not self.complete:
+            self.index = self._scan(size)
+
+        snapshots = self.index[self.index["kind"] == self.SNAPSHOT]
+        self._by_step = {int(e["step"]): e for e in snapshots}
+
+    def _scan(self, size):
+        entries = []
+        offset = self._HEADER_SIZE
+        while offset + self._RECORD.size <= size:
+            kind, _, step, n = self._RECORD.unpack(bytes(self._data[offset:offset + self._RECORD.size]))
+            if kind not in (self.SNAPSHOT, self.FINAL, self.PARAMETERS):
+                break
+            nbytes = n if kind == self.PARAMETERS else 24 * n
+            if offset + self._RECORD.size + nbytes > size:
+                break
+            entries.append((kind, 0, step, offset + self._RECORD.size, n))
+            offset += self._RECORD.size + nbytes
+        return np.array(entries, dtype=self._INDEX)
+
+    def _points(self, entry):
+        return np.frombuffer(self._data, dtype="<f8", count=3 * int(entry["n_items"]), offset=int(entry["offset"])).reshape(-1, 3)
+
+    def steps(self):
+        """Logged steps, in the order they were written."""
+        return list(self._by_step.keys())
+
+    def read_step(self, step):
+        """Positions (n_walkers, 3) at the logged step `step`."""
+        return self._points(self._by_step[step])
+
+    def final_positions(self):
+        """(step, positions) of the final log of the run."""
+        final = self.index[self.index["kind"] == self.FINAL]
+        if len(final) == 0:
+            raise KeyError(f"{self.path} has no final positions.")
+        return int(final[0]["step"]), self._points(final[0])
+
+    def parameters(self):
+        """Run parameters as a dict of strings."""
+        params = self.index[self.index["kind"] == self.PARAMETERS]
+        if len(params) == 0:
+            return {}
+        start, n = int(params[0]["offset"]), int(params[0]["n_items"])
+        text = bytes(self._data[start:start + n]).decode()
+        return dict(line.split("=", 1) for line in text.splitlines() if "=" in line)
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Analyze random walk positions calculating their variance wrt a starting point.")
     parser.add_argument("input_positions", type=str, help="Input file with positions.")
     parser.add_argument("-s", "--starting_point", required=False, type=float, default=(9.5, 5, 5), nargs=3, help="Starting point coordinates (x, y, z).")
     args = parser.parse_args()
 
-    positions = np.loadtxt(args.input_positions)
+    positions = load_snapshot(args.input_positions)
     var = variance(positions, starting_point=args.starting_point)
     print(f"Variance of final positions: {var:.4f}")
\ No newline at end of file
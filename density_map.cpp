@@ -0,0 +1,117 @@
+#include "density_map.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "statistics.h"
+
+static constexpr char DENSITY_MAGIC[8] = {'R','W','D','E','N','0','0','1'};
+
+DensityMap DensityMap::sphere(Point centre, int nLon, int nLat) {
+  if (nLon <= 0 || nLat <= 0) {
+    throw std::invalid_argument("DensityMap::sphere: number of bins must be positive.");
+  }
+  DensityMap map;
+  map._kind = Sphere;
+  map._centre = centre;
+  map._nLon = nLon;
+  map._nLat = nLat;
+  map._nBins = size_t(nLon)*nLat;
+  return map;
+}
+
+DensityMap DensityMap::band(const Surface &surf) {
+  DensityMap map;
+  map._kind = Band;
+  map._index = std::make_shared<const BandIndex>(surf);
+  // bins in construction order, so that the bin of a band point does not depend on the storage order
+  map._bins = surf.permutation();
+  map._points.resize(surf.nPoints());
+  for (int n = 0; n < surf.nPoints(); ++n)
+    map._points[map._bins[n]] = surf[n];
+  map._nBins = surf.nPoints();
+  return map;
+}
+
+long DensityMap::bin(Point p) const {
+  if (_kind == Band) {
+    int n = _index->find(p);
+    return n < 0 ? -1 : _bins[n];
+  }
+
+  double x = p.x - _centre.x;
+  double y = p.y - _centre.y;
+  double z = p.z - _centre.z;
+  double r = std::sqrt(x*x + y*y + z*z);
+  if (r == 0)
+    return -1;
+
+  // equal area cells: uniform in longitude and in sin(latitude) = z/r
+  double lon = std::atan2(y, x);
+  long iLon = std::min<long>(_nLon - 1, std::floor((lon + M_PI) / (2*M_PI) * _nLon));
+  long iLat = std::min<long>(_nLat - 1, std::max<long>(0, std::floor((z/r + 1) / 2 * _nLat)));
+  return iLat*_nLon + iLon;
+}
+
+std::vector<uint32_t> DensityMap::histogram(const Point *walkers, size_t n) const {
+  int nThreads = 1;
+#ifdef _OPENMP
+  nThreads = omp_get_max_threads();
+#endif
+  std::vector<std::vector<uint32_t>> partial(nThreads);
+
+  #pragma omp parallel num_threads(nThreads)
+  {
+    int t = 0;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    std::vector<uint32_t>& counts = partial[t];
+    counts.assign(_nBins, 0);
+    #pragma omp for schedule(static)
+    for (long w = 0; w < (long)n; ++w) {
+      long b = bin(walkers[w]);
+      if (b >= 0)
+        ++counts[b];
+    }
+  }
+
+  std::vector<uint32_t> counts = std::move(partial[0]);
+  for (int t = 1; t < nThreads; ++t) {
+    for (size_t b = 0; b < _nBins; ++b)
+      counts[b] += partial[t][b];
+  }
+  return counts;
+}
+
+std::string DensityMap::header() const {
+  std::string header(DENSITY_MAGIC, sizeof(DENSITY_MAGIC));
+  auto append = [&header](const auto& value) {
+    header.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(uint32_t(_kind));
+  append(uint32_t(0));
+  if (_kind == Sphere) {
+    append(uint64_t(_nLon));
+    append(uint64_t(_nLat));
+    append(_centre);
+  } else {
+    append(uint64_t(_nBins));
+    header.append(reinterpret_cast<const char*>(_points.data()), _points.size()*sizeof(Point));
+  }
+  return header;
+}
+
+
+DensityLog::DensityLog(const std::string &filename, const DensityMap &map, int64_t resumeStep) {
+  openStepLog(_file, filename, map.header(), sizeof(int64_t) + map.nBins()*sizeof(uint32_t), resumeStep);
+}
+
+void DensityLog::write(int64_t step, const std::vector<uint32_t> &counts) {
+  _file.write(reinterpret_cast<const char*>(&step), sizeof(step));
+  _file.write(reinterpret_cast<const char*>(counts.data()), counts.size()*sizeof(uint32_t));
+}
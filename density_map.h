@@ -0,0 +1,75 @@
+#ifndef DENSITY_MAP_H
+#define DENSITY_MAP_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "band_index.h"
+
+/**
+ * @brief Histogram of walker positions over a fixed set of bins.
+ *
+ * Two binnings are available:
+ *  - sphere(): equal-area longitude/latitude cells around a centre (Lambert cylindrical equal-area: bins uniform in
+ *    longitude and in sin(latitude)), directly plottable on a Mollweide projection;
+ *  - band(): one bin per band point of a Surface, for general surfaces. Walkers are counted at the lattice point
+ *    nearest to them; walkers off the band are not counted. Bins follow the construction order of the band, also
+ *    after Surface::reorderMorton.
+ */
+class DensityMap {
+ public:
+  enum Kind : uint32_t {
+    Sphere = 1,
+    Band = 2
+  };
+
+  static DensityMap sphere(Point centre, int nLon, int nLat);
+  static DensityMap band(const Surface& surf);
+
+  Kind kind() const { return _kind; };
+  size_t nBins() const { return _nBins; };
+
+  // Bin of p, -1 if p falls in none
+  long bin(Point p) const;
+
+  // Counts of the walkers in each bin, accumulated in parallel
+  std::vector<uint32_t> histogram(const Point* walkers, size_t n) const;
+
+  /**
+   * @brief Header of a density log: magic "RWDEN001", uint32 kind, uint32 reserved, then
+   *  - Sphere: uint64 nLon, uint64 nLat, centre (3 doubles);
+   *  - Band:   uint64 nBins, then the band points (3 doubles each) in bin order, the construction order of the band.
+   */
+  std::string header() const;
+
+ private:
+  Kind _kind = Sphere;
+  size_t _nBins = 0;
+  Point _centre;
+  int _nLon = 0;
+  int _nLat = 0;
+  std::shared_ptr<const BandIndex> _index;
+  std::vector<Point> _points;
+  std::vector<int> _bins;     // band: bin of each stored band point (Surface::permutation)
+};
+
+/**
+ * @brief Binary log of the density histograms at each logged step (<run>_density.bin).
+ *
+ * DensityMap::header() followed by one record per step: int64 step and nBins uint32 counts.
+ * Read it with load_density in data_analysis.py.
+ */
+class DensityLog {
+  std::fstream _file;
+
+ public:
+  DensityLog(const std::string& filename, const DensityMap& map, int64_t resumeStep = 0);
+
+  void write(int64_t step, const std::vector<uint32_t>& counts);
+  void flush() { _file.flush(); };
+};
+
+#endif  //DENSITY_MAP_H
@@ -0,0 +1,200 @@
+#include "geodesic.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+
+GeodesicField::GeodesicField(std::shared_ptr<const BandIndex> index, std::vector<double> distance) :
+                _index{index},
+                _distance{std::move(distance)} {
+}
+
+double GeodesicField::operator()(Point p) const {
+  int n = _index->find(p);
+  return n < 0 ? std::numeric_limits<double>::quiet_NaN() : _distance[n];
+}
+
+void GeodesicField::moments(const Point *walkers, size_t n, double &mean, double &meanSquared) const {
+  double sum = 0;
+  double sumSquared = 0;
+  long count = 0;
+  #pragma omp parallel for reduction(+:sum,sumSquared,count) schedule(static)
+  for (long w = 0; w < (long)n; ++w) {
+    double d = (*this)(walkers[w]);
+    if (!std::isnan(d)) {
+      sum += d;
+      sumSquared += d*d;
+      ++count;
+    }
+  }
+  mean = count > 0 ? sum / count : 0;
+  meanSquared = count > 0 ? sumSquared / count : 0;
+}
+
+// Lattice points around p searched in the band before falling back to a search over all the band points
+static constexpr int NEAREST_RADIUS = 8;
+
+// Points whose squared distances are kept at a time by closestPoint, on the stack
+static constexpr long NEAREST_BLOCK = 256;
+
+// Index of the point closest to p among points[0..n) (the first one in case of ties), -1 if there are none.
+// Each block is a simd loop computing the distances and their minimum; only a block improving on the minimum is
+// scanned again, for the index.
+template <class Points>
+static int closestPoint(const Points &points, long n, Point p) {
+  double d2[NEAREST_BLOCK];
+  double best = std::numeric_limits<double>::infinity();
+  long index = -1;
+  for (long first = 0; first < n; first += NEAREST_BLOCK) {
+    long count = std::min(NEAREST_BLOCK, n - first);
+    double blockBest = std::numeric_limits<double>::infinity();
+    #pragma omp simd reduction(min:blockBest)
+    for (long i = 0; i < count; ++i) {
+      Point q = points[first + i];
+      d2[i] = (q.x-p.x)*(q.x-p.x) + (q.y-p.y)*(q.y-p.y) + (q.z-p.z)*(q.z-p.z);
+      blockBest = std::min(blockBest, d2[i]);
+    }
+    if (blockBest < best) {
+      best = blockBest;
+      index = first + (std::find(d2, d2 + count, blockBest) - d2);
+    }
+  }
+  return index;
+}
+
+int nearestBandPoint(const Surface &surf, const BandIndex &index, Point p) {
+  int n = index.find(p);
+  if (n < 0)
+    n = index.nearest(p, NEAREST_RADIUS);
+  if (n >= 0)
+    return n;
+  // the band points where they are stored, without a copy into arrays
+  return surf.data() ? closestPoint(surf.data(), surf.nPoints(), p) : closestPoint(surf, surf.nPoints(), p);
+}
+
+int nearestBandPoint(const Point *points, int nPoints, const BandIndex &index, Point p) {
+  int n = index.find(p);
+  if (n < 0)
+    n = index.nearest(p, NEAREST_RADIUS);
+  return n >= 0 ? n : closestPoint(points, nPoints, p);
+}
+
+static double distance(Point a, Point b) {
+  return std::sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) + (a.z-b.z)*(a.z-b.z));
+}
+
+/*
+ * Fast marching update of point m from two accepted points q1, q2 (values d1, d2): the front is linear along the
+ * segment q1-q2, so the candidate is min over t in [0,1] of (1-t) d1 + t d2 + |m - (q1 + t (q2-q1))|.
+ * The minimum is found in closed form; the endpoints give the one-point (Dijkstra) updates.
+ */
+static double twoPointUpdate(double d1, double d2, Point m, Point q1, Point q2) {
+  double ax = m.x - q1.x, ay = m.y - q1.y, az = m.z - q1.z;
+  double ex = q2.x - q1.x, ey = q2.y - q1.y, ez = q2.z - q1.z;
+  double aa = ax*ax + ay*ay + az*az;
+  double ee = ex*ex + ey*ey + ez*ez;
+  double ae = ax*ex + ay*ey + az*ez;
+  double delta = d2 - d1;
+
+  double best = std::min(d1 + std::sqrt(aa), d2 + std::sqrt(std::max(0.0, aa - 2*ae + ee)));
+  if (delta*delta >= ee)
+    return best;
+
+  // stationary points of f(t): e.(a - t e) = delta |a - t e|
+  double c = (ae*ae - delta*delta*aa) / (ee - delta*delta);
+  double disc = ae*ae - ee*c;
+  if (disc < 0)
+    return best;
+  double root = std::sqrt(disc);
+  for (double t : {(ae + root)/ee, (ae - root)/ee}) {
+    if (t > 0 && t < 1 && (ae - t*ee)*delta >= 0) {
+      double g = std::sqrt(std::max(0.0, aa - 2*t*ae + t*t*ee));
+      best = std::min(best, d1 + t*delta + g);
+    }
+  }
+  return best;
+}
+
+GeodesicField fastMarching(const Surface &surf, Point source, std::shared_ptr<const BandIndex> index) {
+  if (!index)
+    index = std::make_shared<const BandIndex>(surf);
+  if (surf.nPoints() == 0) {
+    throw std::runtime_error("fastMarching: surface has no points.");
+  }
+
+  const double inf = std::numeric_limits<double>::infinity();
+  const double h = index->h();
+  const int nPoints = surf.nPoints();
+
+  // faces and edges of the lattice cube: 18 neighbours
+  const int STENCIL_NORM2 = 2;
+  const size_t nNeighbours = BandIndex::stencil(STENCIL_NORM2).size();
+  std::vector<int> neighbours = index->neighbours(surf, STENCIL_NORM2);
+
+  // band points moved onto the surface, so that distances are measured on it and not across the band
+  std::vector<Point> onSurface(nPoints);
+  std::vector<std::array<int,3>> lattice(nPoints);
+  #pragma omp parallel for schedule(static)
+  for (int n = 0; n < nPoints; ++n) {
+    Point p = surf[n];
+    onSurface[n] = surf.project(p);
+    lattice[n] = {int(std::lround(p.x/h)), int(std::lround(p.y/h)), int(std::lround(p.z/h))};
+  }
+  auto adjacent = [&](int a, int b) {
+    int di = lattice[a][0] - lattice[b][0], dj = lattice[a][1] - lattice[b][1], dk = lattice[a][2] - lattice[b][2];
+    return di*di + dj*dj + dk*dk <= STENCIL_NORM2;
+  };
+
+  std::vector<double> dist(nPoints, inf);
+  std::vector<char> known(nPoints, false);
+  using Entry = std::pair<double, int>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> trial;
+
+  // Near the source the front is far from planar and first order updates are least accurate: initialise the
+  // points within a few cells of it with their straight line distance, which matches the geodesic one there
+  const int INIT_RADIUS = 3;
+  Point origin = surf.project(source);
+  int start = nearestBandPoint(surf, *index, source);
+  for (int i = -INIT_RADIUS; i <= INIT_RADIUS; ++i) {
+    for (int j = -INIT_RADIUS; j <= INIT_RADIUS; ++j) {
+      for (int k = -INIT_RADIUS; k <= INIT_RADIUS; ++k) {
+        int m = index->find(lattice[start][0] + i, lattice[start][1] + j, lattice[start][2] + k);
+        if (m >= 0) {
+          dist[m] = distance(onSurface[m], origin);
+          trial.push({dist[m], m});
+        }
+      }
+    }
+  }
+
+  while (!trial.empty()) {
+    auto [d, n] = trial.top();
+    trial.pop();
+    if (known[n] || d > dist[n])
+      continue;   // stale entry
+    known[n] = true;
+
+    // update the neighbours of n from n alone and from n and each accepted neighbour of both
+    for (size_t i = 0; i < nNeighbours; ++i) {
+      int m = neighbours[nNeighbours*n + i];
+      if (m < 0 || known[m])
+        continue;
+
+      double u = d + distance(onSurface[m], onSurface[n]);
+      for (size_t j = 0; j < nNeighbours; ++j) {
+        int q = neighbours[nNeighbours*m + j];
+        if (q < 0 || q == n || !known[q] || !adjacent(q, n))
+          continue;
+        u = std::min(u, twoPointUpdate(d, dist[q], onSurface[m], onSurface[n], onSurface[q]));
+      }
+      if (u < dist[m]) {
+        dist[m] = u;
+        trial.push({u, m});
+      }
+    }
+  }
+
+  return GeodesicField(index, std::move(dist));
+}
@@ -0,0 +1,52 @@
+#ifndef GEODESIC_H
+#define GEODESIC_H
+
+#include <memory>
+#include <vector>
+
+#include "band_index.h"
+
+/**
+ * @brief Geodesic distance from a source point, sampled at the band points of a Surface.
+ *
+ * Looking up the distance of a walker costs one BandIndex query: the value at the lattice point nearest to it.
+ */
+class GeodesicField {
+  std::shared_ptr<const BandIndex> _index;
+  std::vector<double> _distance;
+
+ public:
+  GeodesicField(std::shared_ptr<const BandIndex> index, std::vector<double> distance);
+
+  // Distance at the band point nearest to p, NaN if p is off the band
+  double operator()(Point p) const;
+
+  // Distance at band point `index`
+  double at(int index) const { return _distance[index]; };
+  const std::vector<double>& values() const { return _distance; };
+
+  // Mean distance and mean squared distance of the walkers (parallel reduction). Walkers off the band are skipped
+  void moments(const Point* walkers, size_t n, double& mean, double& meanSquared) const;
+};
+
+/**
+ * @brief Computes the geodesic distance from `source` over the narrow band of `surf` with the fast marching method.
+ *
+ * The front grows from the band point nearest to `source` in order of increasing distance. Band points are first
+ * projected onto the surface, and each point is updated from accepted lattice neighbours (18-point stencil) with
+ * the fast marching triangle update on the projected positions: distances are measured along the surface, not
+ * across the band, and the error decreases as O(h). The plain 6-neighbour eikonal update on the band lattice was
+ * not used because in a band a few cells thick it degenerates into staircase paths (about 5% too long).
+ *
+ * @param surf Surface built with the implicit constructor (its points lie on a lattice of spacing h and it can project).
+ * @param source Starting point, on or near the surface.
+ * @param index Lattice index of `surf`, built on the fly if not provided.
+ */
+GeodesicField fastMarching(const Surface& surf, Point source, std::shared_ptr<const BandIndex> index = nullptr);
+
+// Index of the band point closest to p: the lattice point nearest to p if it is in the band, then a search of the
+// band (BandIndex::nearest) around p, a search over all the band points if it is farther
+int nearestBandPoint(const Surface& surf, const BandIndex& index, Point p);
+int nearestBandPoint(const Point* points, int nPoints, const BandIndex& index, Point p);
+
+#endif  //GEODESIC_H
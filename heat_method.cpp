@@ -0,0 +1,140 @@
+#include "heat_method.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Assembles a*I + b*L, with L the band lattice Laplacian (zero flux where a neighbour is missing)
+static SparseMatrix assemble(const std::vector<int>& neighbours, int nPoints, double a, double b, double h) {
+  SparseMatrix m;
+  m.n = nPoints;
+  m.rowStart.assign(1, 0);
+  for (int i = 0; i < nPoints; ++i) {
+    int degree = 0;
+    // sorted columns: lower neighbours, diagonal, upper neighbours
+    int row[7];
+    int count = 0;
+    for (int d = 0; d < 6; ++d) {
+      int j = neighbours[6*size_t(i) + d];
+      if (j >= 0) {
+        row[count++] = j;
+        ++degree;
+      }
+    }
+    row[count++] = i;
+    std::sort(row, row + count);
+    for (int c = 0; c < count; ++c) {
+      m.column.push_back(row[c]);
+      m.value.push_back(row[c] == i ? a - b*degree/(h*h) : b/(h*h));
+    }
+    m.rowStart.push_back(m.column.size());
+  }
+  return m;
+}
+
+HeatGeodesics::HeatGeodesics(const Surface &surf, std::shared_ptr<const BandIndex> index) :
+                _index{index ? index : std::make_shared<const BandIndex>(surf)},
+                _h{surf.h()},
+                _t{2*surf.h()},
+                _points(surf.nPoints()) {
+  if (surf.nPoints() == 0) {
+    throw std::runtime_error("HeatGeodesics: surface has no points.");
+  }
+
+  const int nPoints = surf.nPoints();
+  for (int n = 0; n < nPoints; ++n)
+    _points[n] = surf[n];
+  _neighbours = _index->neighbours(surf, 1);
+  _onSurface.resize(nPoints);
+  _normals.resize(nPoints);
+  #pragma omp parallel for schedule(static)
+  for (int n = 0; n < nPoints; ++n) {
+    _onSurface[n] = surf.project(_points[n]);
+    _normals[n] = surf.normal(_points[n]);
+  }
+
+  _heat = assemble(_neighbours, nPoints, 1, -_t, _h);
+  _poisson = assemble(_neighbours, nPoints, 0, -1, _h);
+  _heatFactor = std::make_unique<IncompleteCholesky>(_heat);
+  // -L is only semidefinite (constants are in its kernel): shift the diagonal of its preconditioner
+  _poissonFactor = std::make_unique<IncompleteCholesky>(_poisson, 1e-6/(_h*_h));
+}
+
+GeodesicField HeatGeodesics::distanceFrom(Point source) const {
+  const int nPoints = _points.size();
+  const double h = _h;
+
+  // 1. heat diffusion from the points of the band around the source
+  int start = nearestBandPoint(_points.data(), nPoints, *_index, source);
+  Point origin = _onSurface[start];
+  std::vector<double> u0(nPoints, 0);
+  int nSources = 0;
+  #pragma omp parallel for reduction(+:nSources) schedule(static)
+  for (int n = 0; n < nPoints; ++n) {
+    Point p = _onSurface[n];
+    double d2 = (p.x-origin.x)*(p.x-origin.x) + (p.y-origin.y)*(p.y-origin.y) + (p.z-origin.z)*(p.z-origin.z);
+    if (d2 <= h*h) {
+      u0[n] = 1;
+      ++nSources;
+    }
+  }
+  // far from the source the heat is many orders of magnitude below its peak: solve to a tight relative tolerance
+  std::vector<double> u;
+  if (conjugateGradient(_heat, *_heatFactor, u0, u, 1e-12) < 0) {
+    throw std::runtime_error("HeatGeodesics: heat diffusion did not converge.");
+  }
+
+  // 2. normalised tangential direction of decreasing heat
+  std::vector<double> field(3*size_t(nPoints));
+  #pragma omp parallel for schedule(static)
+  for (int n = 0; n < nPoints; ++n) {
+    double g[3];
+    for (int a = 0; a < 3; ++a) {
+      int plus = _neighbours[6*size_t(n) + 2*a];
+      int minus = _neighbours[6*size_t(n) + 2*a + 1];
+      if (plus >= 0 && minus >= 0)
+        g[a] = (u[plus] - u[minus]) / (2*h);
+      else if (plus >= 0)
+        g[a] = (u[plus] - u[n]) / h;
+      else if (minus >= 0)
+        g[a] = (u[n] - u[minus]) / h;
+      else
+        g[a] = 0;
+    }
+    Point normal = _normals[n];
+    double gn = g[0]*normal.x + g[1]*normal.y + g[2]*normal.z;
+    g[0] -= gn*normal.x;
+    g[1] -= gn*normal.y;
+    g[2] -= gn*normal.z;
+    double norm = std::sqrt(g[0]*g[0] + g[1]*g[1] + g[2]*g[2]);
+    for (int a = 0; a < 3; ++a)
+      field[3*size_t(n) + a] = norm > 0 ? -g[a]/norm : 0;
+  }
+
+  // 3. divergence of the field, with the fluxes through the lattice edges used by the Laplacian
+  std::vector<double> divergence(nPoints);
+  #pragma omp parallel for schedule(static)
+  for (int n = 0; n < nPoints; ++n) {
+    double div = 0;
+    for (int d = 0; d < 6; ++d) {
+      int m = _neighbours[6*size_t(n) + d];
+      if (m < 0)
+        continue;
+      int axis = d / 2;
+      double sign = d % 2 == 0 ? 1 : -1;
+      div += sign*(field[3*size_t(n) + axis] + field[3*size_t(m) + axis]) / (2*h);
+    }
+    // -L phi = -div X
+    divergence[n] = -div;
+  }
+
+  // 4. distance up to a constant, fixed by the distance of the source from its nearest band point
+  std::vector<double> phi;
+  if (conjugateGradient(_poisson, *_poissonFactor, divergence, phi) < 0) {
+    throw std::runtime_error("HeatGeodesics: Poisson solve did not converge.");
+  }
+  double shift = phi[start];
+  for (int n = 0; n < nPoints; ++n)
+    phi[n] -= shift;
+
+  return GeodesicField(_index, std::move(phi));
+}
@@ -0,0 +1,48 @@
+#ifndef HEAT_METHOD_H
+#define HEAT_METHOD_H
+
+#include <memory>
+#include <vector>
+
+#include "geodesic.h"
+#include "sparse.h"
+
+/**
+ * @brief Geodesic distances on the band of a Surface with the heat method (Crane, Weischedel, Wardetzky 2013).
+ *
+ * For a source point: diffuse heat from it for a short time t, normalise the (tangential) gradient of the heat
+ * to get the direction of increasing distance X, and recover the distance by solving the Poisson equation
+ * L phi = div X. Both the heat operator (I - tL) and L only depend on the band, so they are assembled, and their
+ * preconditioners factored, once in the constructor: each source then costs two sparse solves.
+ *
+ * L is the 7-point lattice Laplacian restricted to the band (zero flux through its boundary), which approximates
+ * the Laplace-Beltrami operator of the surface for the thin band. The solves use conjugate gradients with a zero
+ * fill-in incomplete Cholesky factor: an exact sparse Cholesky factor of a 3D band would need a fill-reducing
+ * ordering and far more memory. With iterative solves the heat far from the source is lost below the tolerance for
+ * the t = h^2 of the paper, so t = 2h is used (about 1% error on a sphere of radius 4.5 for h <= 0.1).
+ */
+class HeatGeodesics {
+  std::shared_ptr<const BandIndex> _index;
+  double _h;
+  double _t;
+  std::vector<Point> _points;       // band points
+  std::vector<Point> _onSurface;    // band points projected onto the surface
+  std::vector<Point> _normals;
+  std::vector<int> _neighbours;     // 6 per point: +x, -x, +y, -y, +z, -z
+  SparseMatrix _heat;               // I - tL
+  SparseMatrix _poisson;            // -L
+  std::unique_ptr<IncompleteCholesky> _heatFactor;
+  std::unique_ptr<IncompleteCholesky> _poissonFactor;
+
+ public:
+  /**
+   * @param surf Surface built with the implicit constructor.
+   * @param index Lattice index of `surf`, built on the fly if not provided.
+   */
+  HeatGeodesics(const Surface& surf, std::shared_ptr<const BandIndex> index = nullptr);
+
+  // Geodesic distance from `source` to every band point
+  GeodesicField distanceFrom(Point source) const;
+};
+
+#endif  //HEAT_METHOD_H
@@ -0,0 +1,97 @@
+#include "log_schedule.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+LogSchedule LogSchedule::every(int stride) {
+  if (stride <= 0) {
+    throw std::invalid_argument("LogSchedule::every: stride must be positive.");
+  }
+  LogSchedule schedule;
+  schedule._stride = stride;
+  schedule._description = "every:" + std::to_string(stride);
+  return schedule;
+}
+
+LogSchedule LogSchedule::logarithmic(int perDecade) {
+  if (perDecade <= 0) {
+    throw std::invalid_argument("LogSchedule::logarithmic: steps per decade must be positive.");
+  }
+  // the steps are a property of the schedule alone, so they are generated once for the whole int range
+  std::vector<int> steps = {0};
+  for (int i = 0; ; ++i) {
+    double t = std::floor(std::pow(10.0, double(i) / perDecade));
+    if (t >= INT_MAX)
+      break;
+    if (int(t) != steps.back())
+      steps.push_back(int(t));
+  }
+  LogSchedule schedule;
+  schedule._steps = steps;
+  schedule._description = "log:" + std::to_string(perDecade);
+  return schedule;
+}
+
+LogSchedule LogSchedule::steps(std::vector<int> steps) {
+  std::sort(steps.begin(), steps.end());
+  steps.erase(std::unique(steps.begin(), steps.end()), steps.end());
+
+  LogSchedule schedule;
+  schedule._steps = steps;
+  schedule._description = "list:";
+  for (size_t i = 0; i < steps.size(); ++i) {
+    schedule._description += (i > 0 ? "," : "") + std::to_string(steps[i]);
+  }
+  return schedule;
+}
+
+LogSchedule LogSchedule::parse(const std::string &spec) {
+  size_t colon = spec.find(':');
+  std::string kind = colon == std::string::npos ? "every" : spec.substr(0, colon);
+  std::string value = colon == std::string::npos ? spec : spec.substr(colon + 1);
+
+  try {
+    if (kind == "every")
+      return every(std::stoi(value));
+    if (kind == "log")
+      return logarithmic(std::stoi(value));
+    if (kind == "list") {
+      std::vector<int> list;
+      std::istringstream items(value);
+      std::string item;
+      while (std::getline(items, item, ','))
+        list.push_back(std::stoi(item));
+      return steps(list);
+    }
+  } catch (const std::logic_error&) {
+    // invalid or out of range numbers are reported below
+  }
+  throw std::invalid_argument("LogSchedule::parse: invalid log schedule '" + spec + "'.");
+}
+
+bool LogSchedule::contains(int step) const {
+  if (_stride > 0)
+    return step % _stride == 0;
+  return std::binary_search(_steps.begin(), _steps.end(), step);
+}
+
+int LogSchedule::count(int nSteps) const {
+  if (nSteps <= 0)
+    return 0;
+  if (_stride > 0)
+    return (nSteps - 1) / _stride + 1;
+  return std::lower_bound(_steps.begin(), _steps.end(), nSteps) - std::lower_bound(_steps.begin(), _steps.end(), 0);
+}
+
+std::vector<int> loggedWalkers(int nWalkers, int nLogged) {
+  if (nLogged <= 0 || nLogged > nWalkers)
+    nLogged = nWalkers;
+
+  std::vector<int> indices(nLogged);
+  for (int i = 0; i < nLogged; ++i) {
+    indices[i] = (long long)i * nWalkers / nLogged;
+  }
+  return indices;
+}
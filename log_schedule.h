@@ -0,0 +1,48 @@
+#ifndef LOG_SCHEDULE_H
+#define LOG_SCHEDULE_H
+
+#include <string>
+#include <vector>
+
+// Steps at which simulate() logs a snapshot
+class LogSchedule {
+  int _stride = 0;              // > 0: every `stride` steps
+  std::vector<int> _steps;      // otherwise: sorted list of steps
+  std::string _description;
+
+ public:
+  // Every `stride` steps, starting from step 0
+  static LogSchedule every(int stride);
+
+  // Step 0 and about `perDecade` steps per decade of time, logarithmically spaced (1, 2, 3, 5, 8, 13, ...)
+  static LogSchedule logarithmic(int perDecade);
+
+  // Exactly the given steps
+  static LogSchedule steps(std::vector<int> steps);
+
+  /**
+   * @brief Builds a schedule from its command line form.
+   *
+   * "N" or "every:N" for a fixed stride, "log:K" for K steps per decade, "list:a,b,c" for explicit steps.
+   * Throws std::invalid_argument if `spec` is malformed.
+   */
+  static LogSchedule parse(const std::string& spec);
+
+  bool contains(int step) const;
+
+  // Number of steps logged in [0, nSteps)
+  int count(int nSteps) const;
+
+  // Command line form of the schedule, accepted by parse()
+  const std::string& describe() const { return _description; };
+};
+
+/**
+ * @brief Indices of the walkers written at each snapshot.
+ *
+ * The `nLogged` indices are evenly spread over [0, nWalkers), so the same walkers are followed for the whole run.
+ * If nLogged is 0 or not smaller than nWalkers, all the walkers are logged.
+ */
+std::vector<int> loggedWalkers(int nWalkers, int nLogged);
+
+#endif  //LOG_SCHEDULE_H
@@ -1,91 +1,66 @@
-#include <cmath>
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
-#include <functional>
-#include <fstream>
-#include <random>
-#include <filesystem>
-
-#include "surface.h"
-
-//convert double to string with 2 decimal places
-auto to_string2 = [](double value) {
-  std::ostringstream out;
-  out << std::fixed << std::setprecision(2) << value;
-  return out.str();
-};
-
-auto sphere = [](Point center, double r) {
-  return [=](double x, double y, double z) {
-    return std::sqrt((x-center.x)*(x-center.x) + (y-center.y)*(y-center.y) + (z-center.z)*(z-center.z)) - r;
-  };
-};
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
 
-void simulate(Surface const& surf, Point startingPoint, double stepSize, int nSteps,
-              bool snap = false, int nWalkers = 10000, std::string outputDir = "data") {
+#include "simulation.h"
+#include "sweep.h"
+#include "checkpoint.h"
+#include "heat_method.h"
+#include "result_cache.h"
 
-  Point walkers[nWalkers];
-  for (int w = 0; w < nWalkers; ++w) {
-    walkers[w] = startingPoint;
-  }
-
-  std::random_device dev;
-  std::mt19937 rng(dev());
-  std::uniform_int_distribution<std::mt19937::result_type> dist(0,5); // distribution in range [0,5]
-
-  // create output directory recursively
-  std::filesystem::create_directories(outputDir);
-  std::ofstream fout;
-  for (int step = 0; step < nSteps; ++step) {
-    if ((step) % 10 == 0) {
-      std::string filename = outputDir + "/step" + std::to_string(step) + ".dat";
-      fout.open(filename);
-    }
-
-    for (int w = 0; w < nWalkers; ++w) {
-      // chose a random direction (up, down, left, right, forward, backward)
-      int direction = dist(rng);
-      
-      // log position every 10 steps
-      if (step % 10 == 0) {
-        fout << walkers[w] << '\n';
-      }
-
-      switch(direction) {
-        case 0: walkers[w].x += stepSize; break; //right
-        case 1: walkers[w].x -= stepSize; break; //left
-        case 2: walkers[w].y += stepSize; break; //up
-        case 3: walkers[w].y -= stepSize; break; //down
-        case 4: walkers[w].z += stepSize; break; //forward
-        case 5: walkers[w].z -= stepSize; break; //backward
-      }
-
-      // project back to the surface
-      walkers[w] = surf.project(walkers[w]);
-
-      // optionally, snap to nearest point
-      walkers[w] = surf.snap(walkers[w]);
-    }
-    fout.close();
-  }
-
-  // Log a final time
-  std::string filename = "stepsize=" + to_string2(stepSize) + "_step" + std::to_string(nSteps) + ".dat";
-  fout.open(filename);
-  for (int w = 0; w < nWalkers; ++w) {
-    fout << walkers[w] << '\n';
-  }
-  fout.close();
+//convert double to its shortest string (%g) for file names: 0.5, 0.0125, 1e-05
+auto to_name = [](double value) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%g", value);
+  return std::string(buffer);
+};
 
-  std::cout << "Simulation completed: " << nWalkers << " walkers, " << nSteps << " steps each, step size " << stepSize << ".\n";
+// Comma separated list of values, e.g. 0.1,0.2,0.5
+template <class T>
+std::vector<T> parseList(const std::string& list, T (*parse)(const std::string&)) {
+  std::vector<T> values;
+  std::istringstream items(list);
+  std::string item;
+  while (std::getline(items, item, ','))
+    values.push_back(parse(item));
+  return values;
 }
 
-
 // Default parameters
 double STEP_SIZE = 2;
 int N_STEPS = 10000;
 bool SNAP = true;
 int N_WALKERS = 10000;
 double GRID_H = 0.06;
+std::string RING_NAME = "";
+int RING_SLOTS = 8;
+OutputFormat FORMAT = OutputFormat::Text;
+std::string LOG_SCHEDULE = "every:10";
+int N_LOGGED = 0;
+int SORT_EVERY = 0;               // steps between two spatial sorts of the walkers, 0: never
+bool VARIANCE = false;
+bool MOMENTS = false;
+Point CENTRE = {5, 5, 5};
+std::string DENSITY = "";
+std::string GEODESIC = "";
+int CHECKPOINT_EVERY = 0;
+bool RESUME = false;
+std::string STEP_SIZES = "";      // sweep lists, empty: the positional value (0.1 to STEP_SIZE by 0.1 for step sizes)
+std::string SNAPS = "";
+std::string WALKERS = "";
+std::string GRID_HS = "";
+std::string SURFACES = "sphere";
+int JOBS = 0;                     // concurrent runs, 0: one per hardware thread
+uint64_t SEED = 0;                // 0: random seeds
+std::string CACHE_DIR = "";       // content-addressed results, see result_cache.h
+std::string SURFACE_CACHE = "";   // band points of the surfaces already built, see surface_cache.h
+BandOptions BAND;                 // storage of the band points, see sweep.h
 
 int main(int argc, char** argv) {
   // Show help message
@@ -98,36 +73,243 @@ int main(int argc, char** argv) {
       std::cout << "  SNAP:      Whether to snap to surface or not (default: false)\n";
       std::cout << "  N_WALKERS: Number of walkers to simulate (default: 10000)\n";
       std::cout << "  GRID_H:    Grid spacing for surface construction (default: 0.06)\n";
+      std::cout << "Options:\n";
+      std::cout << "  --live-ring NAME  Publish the latest snapshots to the shared memory segment /NAME\n";
+      std::cout << "  --ring-slots N    Number of snapshots kept in the live ring (default: 8)\n";
+      std::cout << "  --format FORMAT   text: one .dat file per snapshot, run: a single .rwrun file per run,\n";
+      std::cout << "                    none: no snapshots, only statistics (default: text)\n";
+      std::cout << "  --variance        Write the geodesic variance at each logged step to <run>_variance.csv\n";
+      std::cout << "  --moments         Write mean, standard error, 95% CI, skewness and kurtosis of positions,\n";
+      std::cout << "                    displacement and geodesic angle at each logged step to <run>_moments.csv\n";
+      std::cout << "                    (mergeable accumulator states in <run>_moments.bin)\n";
+      std::cout << "  --density MAP     Write histograms of the walkers at each logged step to <run>_density.bin. MAP is\n";
+      std::cout << "                    sphere:NLON,NLAT (equal-area cells around the centre) or band (one bin per band point)\n";
+      std::cout << "  --geodesic fmm|heat  Write mean and mean squared geodesic distance from the starting point at each\n";
+      std::cout << "                    logged step to <run>_geodesic.csv, any surface (fast marching or heat method\n";
+      std::cout << "                    on the band)\n";
+      std::cout << "  --centre X Y Z    Centre used for geodesic angles (default: 5 5 5, the centre of the sphere)\n";
+      std::cout << "  --log SCHEDULE    Steps to log: every:N, log:K (K steps per decade) or list:a,b,c (default: every:10)\n";
+      std::cout << "  --log-walkers M   Log only M walkers, evenly spread over the ensemble (default: all)\n";
+      std::cout << "  --sort-walkers K  Re-sort the walkers in memory by lattice cell (Morton order) every K steps,\n";
+      std::cout << "                    for cache-friendly per-walker lookups; the results do not change (default: off)\n";
+      std::cout << "  --checkpoint-every N  Write a checkpoint of each run every N steps (default: off, 1000 with --resume)\n";
+      std::cout << "  --resume          Continue the runs from their last checkpoint, skipping the completed ones\n";
+      std::cout << "Sweeps (all the combinations of the values are run, lists are comma separated):\n";
+      std::cout << "  --step-sizes LIST Step sizes (default: 0.1 to STEP_SIZE by 0.1)\n";
+      std::cout << "  --snap LIST       Snap values, 0 and/or 1 (default: SNAP)\n";
+      std::cout << "  --walkers LIST    Numbers of walkers (default: N_WALKERS)\n";
+      std::cout << "  --grid-h LIST     Grid spacings (default: GRID_H)\n";
+      std::cout << "  --surfaces LIST   Surfaces: sphere, torus (default: sphere)\n";
+      std::cout << "  --jobs N          Runs executed concurrently (default: one per hardware thread)\n";
+      std::cout << "  --seed S          Derive a reproducible seed for each run from S (default: random seeds)\n";
+      std::cout << "  --cache DIR       Store the outputs of each run in DIR/<hash of its parameters>/ and skip the runs\n";
+      std::cout << "                    already completed there\n";
+      std::cout << "  --surface-cache DIR  Load the surfaces from DIR when they were already built, save them otherwise\n";
+      std::cout << "                    (memory-mapped and shared by concurrent processes; /dev/shm/DIR keeps them in RAM)\n";
+      std::cout << "  --packed-band     Store the band points as packed lattice indices (8 bytes per point instead of 24);\n";
+      std::cout << "                    ignored with --surface-cache, whose mapped bands are shared between processes\n";
+      std::cout << "  --morton-band     Store the band points in Z-order, for faster --geodesic and band --density\n";
+      std::cout << "                    (band density bins keep the construction order of the band); with\n";
+      std::cout << "                    --surface-cache the reordered band is cached, in its own file\n";
+      std::cout << "  --refine-bands    Build the band of each grid spacing from the next coarser one that is a multiple\n";
+      std::cout << "                    of it (e.g. --grid-h 0.1,0.05,0.025), evaluating phi only near the coarse band\n";
       return 0;
     }
   }
+  // Parse command line options, what is left are the positional arguments
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--live-ring" && i + 1 < argc) RING_NAME = argv[++i];
+    else if (arg == "--ring-slots" && i + 1 < argc) RING_SLOTS = std::stoi(argv[++i]);
+    else if (arg == "--log" && i + 1 < argc) LOG_SCHEDULE = argv[++i];
+    else if (arg == "--log-walkers" && i + 1 < argc) N_LOGGED = std::stoi(argv[++i]);
+    else if (arg == "--sort-walkers" && i + 1 < argc) SORT_EVERY = std::stoi(argv[++i]);
+    else if (arg == "--checkpoint-every" && i + 1 < argc) CHECKPOINT_EVERY = std::stoi(argv[++i]);
+    else if (arg == "--resume") RESUME = true;
+    else if (arg == "--variance") VARIANCE = true;
+    else if (arg == "--moments") MOMENTS = true;
+    else if (arg == "--density" && i + 1 < argc) DENSITY = argv[++i];
+    else if (arg == "--geodesic" && i + 1 < argc) GEODESIC = argv[++i];
+    else if (arg == "--step-sizes" && i + 1 < argc) STEP_SIZES = argv[++i];
+    else if (arg == "--snap" && i + 1 < argc) SNAPS = argv[++i];
+    else if (arg == "--walkers" && i + 1 < argc) WALKERS = argv[++i];
+    else if (arg == "--grid-h" && i + 1 < argc) GRID_HS = argv[++i];
+    else if (arg == "--surfaces" && i + 1 < argc) SURFACES = argv[++i];
+    else if (arg == "--jobs" && i + 1 < argc) JOBS = std::stoi(argv[++i]);
+    else if (arg == "--seed" && i + 1 < argc) SEED = std::stoull(argv[++i]);
+    else if (arg == "--cache" && i + 1 < argc) CACHE_DIR = argv[++i];
+    else if (arg == "--surface-cache" && i + 1 < argc) SURFACE_CACHE = argv[++i];
+    else if (arg == "--packed-band") BAND.packed = true;
+    else if (arg == "--morton-band") BAND.morton = true;
+    else if (arg == "--refine-bands") BAND.refine = true;
+    else if (arg == "--centre" && i + 3 < argc) {
+      CENTRE.x = std::stod(argv[++i]);
+      CENTRE.y = std::stod(argv[++i]);
+      CENTRE.z = std::stod(argv[++i]);
+    }
+    else if (arg == "--format" && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format == "text") FORMAT = OutputFormat::Text;
+      else if (format == "run") FORMAT = OutputFormat::RunFile;
+      else if (format == "none") FORMAT = OutputFormat::None;
+      else throw std::invalid_argument("Unknown output format: " + format);
+    }
+    else args.push_back(arg);
+  }
+
   // Parse command line arguments
-  if (argc > 1) STEP_SIZE = std::stod(argv[1]);
-  if (argc > 2) N_STEPS = std::stoi(argv[2]);
-  if (argc > 3) SNAP = std::stoi(argv[3]);
-  if (argc > 4) N_WALKERS = std::stoi(argv[4]);
-  if (argc > 5) GRID_H = std::stod(argv[5]);
-
-  for (double size = 0.1; size <= STEP_SIZE; size += 0.1) {
-    std::cout << "Running simulation with step size: " << size << "\n";
-  // Define the domain and grid spacing
-  Interval x = {0,10};
-  Interval y = {0,10};
-  Interval z = {0,10};
-
-  Surface surf = Surface(sphere({5,5,5}, 4.5), x, y, z, GRID_H);
-  std::cout << "Surface created with " << surf.nPoints() << " points.\n";
-
-  Point right = {9.5, 5, 5};
-    
-    std::string outputDir;
-    if (SNAP) 
-      outputDir = "data/snap/stepSize=" + to_string2(size) + "_nWalkers=" + std::to_string(N_WALKERS);
-    else
-      outputDir = "data/nosnap/stepSize=" + to_string2(size) + "_nWalkers=" + std::to_string(N_WALKERS);
-  
-    simulate(surf, right, size, N_STEPS, SNAP, N_WALKERS, outputDir);
+  if (args.size() > 0) STEP_SIZE = std::stod(args[0]);
+  if (args.size() > 1) N_STEPS = std::stoi(args[1]);
+  if (args.size() > 2) SNAP = std::stoi(args[2]);
+  if (args.size() > 3) N_WALKERS = std::stoi(args[3]);
+  if (args.size() > 4) GRID_H = std::stod(args[4]);
+
+  LogSchedule schedule = LogSchedule::parse(LOG_SCHEDULE);
+
+  if (RESUME && CHECKPOINT_EVERY == 0)
+    CHECKPOINT_EVERY = 1000;
+  // stop cleanly on SIGTERM/SIGINT, writing a checkpoint
+  if (CHECKPOINT_EVERY > 0)
+    installStopHandlers();
+
+  // The sweep: Cartesian product of the parameter lists
+  auto parseDouble = [](const std::string& s) { return std::stod(s); };
+  auto parseInt = [](const std::string& s) { return std::stoi(s); };
+  SweepParameters parameters;
+  parameters.nSteps = N_STEPS;
+  parameters.surfaces = parseList<std::string>(SURFACES, [](const std::string& s) { return s; });
+  parameters.gridH = GRID_HS.empty() ? std::vector<double>{GRID_H} : parseList<double>(GRID_HS, parseDouble);
+  parameters.nWalkers = WALKERS.empty() ? std::vector<int>{N_WALKERS} : parseList<int>(WALKERS, parseInt);
+  for (int snap : SNAPS.empty() ? std::vector<int>{SNAP} : parseList<int>(SNAPS, parseInt))
+    parameters.snap.push_back(snap);
+  if (STEP_SIZES.empty()) {
+    for (double size = 0.1; size <= STEP_SIZE; size += 0.1)
+      parameters.stepSizes.push_back(size);
+  } else {
+    parameters.stepSizes = parseList<double>(STEP_SIZES, parseDouble);
+  }
+  std::vector<SweepJob> jobs = sweepJobs(parameters);
+
+  // Canonical description of a job: the simulation itself, then everything else its outputs depend on
+  auto number = [](double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return std::string(buffer);
+  };
+  auto simulationKey = [&](const SweepJob& job) {
+    return "rwalk-surface/1 surface={" + surfaceSpec(job.surface).description + "} h=" + number(job.gridH) +
+           " stepSize=" + number(job.stepSize) + " snap=" + std::to_string(job.snap) +
+           " nWalkers=" + std::to_string(job.nWalkers) + " nSteps=" + std::to_string(job.nSteps);
+  };
+  auto jobKey = [&](const SweepJob& job) {
+    const char* format = FORMAT == OutputFormat::Text ? "text" : FORMAT == OutputFormat::RunFile ? "run" : "none";
+    return simulationKey(job) + " seed=" + std::to_string(job.seed) + " format=" + format +
+           " log=" + schedule.describe() + " logged=" + std::to_string(N_LOGGED) +
+           " variance=" + std::to_string(VARIANCE) + " moments=" + std::to_string(MOMENTS) +
+           " density=" + DENSITY + " geodesic=" + GEODESIC + " band=" + (BAND.morton ? "morton" : "lattice") +
+           " centre=" + number(CENTRE.x) + "," + number(CENTRE.y) + "," + number(CENTRE.z);
+  };
+  // Each job gets its own stream, derived from the base seed and its parameters (not from the output options)
+  if (SEED != 0) {
+    for (auto& job : jobs) {
+      job.seed = SEED ^ std::stoull(ResultCache::hash(simulationKey(job)), nullptr, 16);
+      if (job.seed == 0)
+        job.seed = SEED;
+    }
+  }
+
+  std::unique_ptr<ResultCache> cache;
+  if (!CACHE_DIR.empty()) {
+    cache = std::make_unique<ResultCache>(CACHE_DIR);
+    size_t nJobs = jobs.size();
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&](const SweepJob& job) { return cache->completed(jobKey(job)); }),
+               jobs.end());
+    std::cout << nJobs - jobs.size() << " of " << nJobs << " simulations found in the cache " << CACHE_DIR << ".\n";
+  }
+  int nThreads = JOBS > 0 ? JOBS : std::max(1u, std::thread::hardware_concurrency());
+
+  // A single ring is shared by all the runs: viewers see the frames of the concurrent runs interleaved
+  std::unique_ptr<SnapshotRing> ring;
+  if (!RING_NAME.empty()) {
+    int maxWalkers = *std::max_element(parameters.nWalkers.begin(), parameters.nWalkers.end());
+    ring = std::make_unique<SnapshotRing>(RING_NAME, RING_SLOTS, maxWalkers);
+    std::cout << "Publishing live snapshots to shared memory segment " << ring->name() << ".\n";
+  }
+
+  // Data shared by the runs on the same surface
+  std::mutex outputMutex;
+  auto prepare = [&](SweepSurface& surface) {
+    const Surface& surf = *surface.surface;
+    if (DENSITY == "band") {
+      surface.density = std::make_unique<DensityMap>(DensityMap::band(surf));
+    } else if (DENSITY.rfind("sphere:", 0) == 0) {
+      size_t comma = DENSITY.find(',');
+      if (comma == std::string::npos)
+        throw std::invalid_argument("Invalid density map: " + DENSITY);
+      surface.density = std::make_unique<DensityMap>(DensityMap::sphere(CENTRE, std::stoi(DENSITY.substr(7, comma - 7)),
+                                                                        std::stoi(DENSITY.substr(comma + 1))));
+    } else if (!DENSITY.empty()) {
+      throw std::invalid_argument("Invalid density map: " + DENSITY);
+    }
+
+    if (GEODESIC == "fmm")
+      surface.geodesic = std::make_unique<GeodesicField>(fastMarching(surf, surface.spec.start));
+    else if (GEODESIC == "heat")
+      surface.geodesic = std::make_unique<GeodesicField>(HeatGeodesics(surf).distanceFrom(surface.spec.start));
+    else if (!GEODESIC.empty())
+      throw std::invalid_argument("Unknown geodesic method: " + GEODESIC);
+
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::cout << "Surface " << surface.spec.name << " created with " << surf.nPoints() << " points (h = " << surface.h << ").\n";
+  };
+
+  auto outputDirectory = [&](const SweepJob& job) {
+    if (cache)
+      return cache->directory(jobKey(job)) + "/run";
+    std::string outputDir = "data/";
+    if (job.surface != "sphere")
+      outputDir += job.surface + "/";
+    outputDir += (job.snap ? "snap/" : "nosnap/");
+    outputDir += "stepSize=" + to_name(job.stepSize) + "_nWalkers=" + std::to_string(job.nWalkers);
+    if (parameters.gridH.size() > 1)
+      outputDir += "_h=" + to_name(job.gridH);
+    return outputDir;
+  };
+  // concurrent runs writing to the same files would corrupt each other's outputs
+  std::set<std::string> outputDirs;
+  for (auto const& job : jobs) {
+    if (!outputDirs.insert(outputDirectory(job)).second)
+      throw std::invalid_argument("Two runs of the sweep write to " + outputDirectory(job) + ": remove the repeated values.");
+  }
+
+  auto run = [&](const SweepJob& job, const SweepSurface& surface) {
+    std::string key = jobKey(job);
+    std::string outputDir = outputDirectory(job);
+    {
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cout << "Running simulation with step size: " << job.stepSize << " (" << outputDir << ")\n";
+    }
+
+    CheckpointOptions checkpoint;
+    if (CHECKPOINT_EVERY > 0)
+      checkpoint = {outputDir + ".ckpt", CHECKPOINT_EVERY, RESUME};
+
+    OutputOptions output = {outputDir, FORMAT, schedule, N_LOGGED, ring.get(), VARIANCE, MOMENTS, CENTRE,
+                            surface.density.get(), surface.geodesic.get(), surface.spec.description};
+    if (!simulate(*surface.surface, surface.spec.start, job.stepSize, job.nSteps, job.snap, job.nWalkers, output,
+                  checkpoint, job.seed, SORT_EVERY))
+      return false;
+    if (cache)
+      cache->markCompleted(key);
+    return true;
+  };
+
+  std::cout << "Running " << jobs.size() << " simulations on " << std::min<size_t>(nThreads, jobs.size()) << " threads.\n";
+  if (!runSweep(jobs, nThreads, prepare, run, SURFACE_CACHE, BAND)) {
+    std::cout << "Interrupted: run again with --resume to continue.\n";
+    return 1;
   }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,145 @@
+#include "manifest.h"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+static std::string jsonString(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out + "\"";
+}
+
+// Shortest round trip representation; JSON has no nan or inf
+static std::string jsonNumber(double value) {
+  if (!std::isfinite(value))
+    return "null";
+  char buffer[32];
+  auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  return std::string(buffer, res.ptr);
+}
+
+static std::string jsonObject(const std::vector<std::pair<std::string, std::string>>& section) {
+  std::string out = "{";
+  for (size_t i = 0; i < section.size(); ++i) {
+    out += (i > 0 ? ", " : "") + jsonString(section[i].first) + ": " + section[i].second;
+  }
+  return out + "}";
+}
+
+RunManifest::RunManifest(std::string filename, std::string format) :
+                _filename{std::move(filename)},
+                _format{std::move(format)} {
+}
+
+void RunManifest::set(std::vector<std::pair<std::string, std::string>> &section, const std::string &key, std::string json) {
+  for (auto& entry : section) {
+    if (entry.first == key) {
+      entry.second = std::move(json);
+      return;
+    }
+  }
+  section.emplace_back(key, std::move(json));
+}
+
+void RunManifest::parameter(const std::string &key, const std::string &value) {
+  set(_parameters, key, jsonString(value));
+}
+
+void RunManifest::parameter(const std::string &key, double value) {
+  set(_parameters, key, jsonNumber(value));
+}
+
+void RunManifest::parameter(const std::string &key, int64_t value) {
+  set(_parameters, key, std::to_string(value));
+}
+
+void RunManifest::parameter(const std::string &key, Point value) {
+  set(_parameters, key, "[" + jsonNumber(value.x) + ", " + jsonNumber(value.y) + ", " + jsonNumber(value.z) + "]");
+}
+
+void RunManifest::surface(const std::string &description, int64_t nPoints, double h) {
+  set(_surface, "description", jsonString(description));
+  set(_surface, "nPoints", std::to_string(nPoints));
+  set(_surface, "h", jsonNumber(h));
+}
+
+void RunManifest::timing(const std::string &key, double seconds) {
+  set(_timings, key, jsonNumber(seconds));
+}
+
+void RunManifest::timing(const std::string &key, const std::string &value) {
+  set(_timings, key, jsonString(value));
+}
+
+static std::string relativeTo(const std::string& file, const std::string& manifest) {
+  std::filesystem::path dir = std::filesystem::path(manifest).parent_path();
+  return std::filesystem::path(file).lexically_relative(dir.empty() ? "." : dir).string();
+}
+
+void RunManifest::output(const std::string &name, const std::string &file) {
+  set(_outputs, name, jsonString(relativeTo(file, _filename)));
+}
+
+void RunManifest::snapshot(int64_t step, const std::string &file, uint64_t offset, uint64_t bytes, uint64_t nPoints,
+                           bool final) {
+  _snapshots.push_back({step, relativeTo(file, _filename), offset, bytes, nPoints, final});
+}
+
+void RunManifest::write(bool completed, int64_t lastStep) const {
+  std::string tmp = _filename + ".tmp";
+  std::ofstream out(tmp, std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("RunManifest::write: cannot open " + tmp + ".");
+  }
+  out << "{\n";
+  out << "  \"version\": 1,\n";
+  out << "  \"format\": " << jsonString(_format) << ",\n";
+  out << "  \"completed\": " << (completed ? "true" : "false") << ",\n";
+  out << "  \"lastStep\": " << lastStep << ",\n";
+  out << "  \"parameters\": " << jsonObject(_parameters) << ",\n";
+  out << "  \"surface\": " << jsonObject(_surface) << ",\n";
+  out << "  \"timings\": " << jsonObject(_timings) << ",\n";
+  out << "  \"outputs\": " << jsonObject(_outputs) << ",\n";
+  out << "  \"snapshots\": [";
+  for (size_t i = 0; i < _snapshots.size(); ++i) {
+    const Snapshot& s = _snapshots[i];
+    out << (i > 0 ? ",\n    " : "\n    ") << "{\"step\": " << s.step << ", \"file\": " << jsonString(s.file)
+        << ", \"offset\": " << s.offset << ", \"bytes\": " << s.bytes << ", \"nPoints\": " << s.nPoints
+        << ", \"final\": " << (s.final ? "true" : "false") << "}";
+  }
+  out << (_snapshots.empty() ? "]\n" : "\n  ]\n");
+  out << "}\n";
+  out.close();
+  if (!out) {
+    throw std::runtime_error("RunManifest::write: cannot write " + tmp + ".");
+  }
+  std::filesystem::rename(tmp, _filename);
+}
+
+std::string isoTime() {
+  std::time_t now = std::time(nullptr);
+  std::tm utc;
+  gmtime_r(&now, &utc);
+  char buffer[32];
+  std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  return buffer;
+}
@@ -0,0 +1,72 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * @brief JSON description of a run (<run>_manifest.json): parameters, surface, snapshots and timings.
+ *
+ * Analysis code finds every snapshot of a run from this single small file (see load_manifest in data_analysis.py)
+ * instead of listing run directories and parsing step numbers and parameters out of file names.
+ *
+ * Layout:
+ *   {"version": 1, "format": "text"|"run"|"none", "completed": bool, "lastStep": int,
+ *    "parameters": {...}, "surface": {...}, "timings": {...}, "outputs": {"variance": "file", ...},
+ *    "snapshots": [{"step": int, "file": "path", "offset": bytes, "bytes": bytes, "nPoints": int, "final": bool}]}
+ * Paths are relative to the directory of the manifest. `offset` and `bytes` locate the snapshot in `file`: the
+ * whole text file, or the packed doubles of a record of a run file.
+ */
+class RunManifest {
+ public:
+  struct Snapshot {
+    int64_t step;
+    std::string file;
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t nPoints;
+    bool final;
+  };
+
+ private:
+  std::string _filename;
+  std::string _format;
+  // values are kept already encoded as JSON, in insertion order
+  std::vector<std::pair<std::string, std::string>> _parameters;
+  std::vector<std::pair<std::string, std::string>> _surface;
+  std::vector<std::pair<std::string, std::string>> _timings;
+  std::vector<std::pair<std::string, std::string>> _outputs;
+  std::vector<Snapshot> _snapshots;
+
+  static void set(std::vector<std::pair<std::string, std::string>>& section, const std::string& key, std::string json);
+
+ public:
+  RunManifest(std::string filename, std::string format);
+
+  void parameter(const std::string& key, const std::string& value);
+  void parameter(const std::string& key, double value);
+  void parameter(const std::string& key, int64_t value);
+  void parameter(const std::string& key, Point value);
+
+  void surface(const std::string& description, int64_t nPoints, double h);
+  void timing(const std::string& key, double seconds);
+  void timing(const std::string& key, const std::string& value);
+
+  // `file` is made relative to the directory of the manifest
+  void output(const std::string& name, const std::string& file);
+  void snapshot(int64_t step, const std::string& file, uint64_t offset, uint64_t bytes, uint64_t nPoints,
+                bool final = false);
+  const std::vector<Snapshot>& snapshots() const { return _snapshots; };
+
+  // Writes the manifest (to a temporary file renamed over the previous version, as for checkpoints)
+  void write(bool completed, int64_t lastStep) const;
+};
+
+// Current UTC time in ISO 8601 format, e.g. 2024-05-01T12:00:00Z
+std::string isoTime();
+
+#endif  //MANIFEST_H
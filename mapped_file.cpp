@@ -0,0 +1,35 @@
+#include "mapped_file.h"
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &filename) :
+                _filename{filename} {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("MappedFile: cannot open " + filename + ".");
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("MappedFile: cannot stat " + filename + ".");
+  }
+  _size = info.st_size;
+  if (_size > 0) {
+    _base = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    if (_base == MAP_FAILED) {
+      _base = nullptr;
+      close(fd);
+      throw std::runtime_error("MappedFile: cannot map " + filename + ".");
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (_base != nullptr)
+    munmap(_base, _size);
+}
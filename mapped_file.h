@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * The mapping is shared (MAP_SHARED): every process mapping the same file uses the same physical pages of the page
+ * cache, so N processes reading a multi-GB file hold a single copy of it. A file under /dev/shm behaves as a POSIX
+ * shared memory segment. Files must be replaced by renaming a new file over them, never rewritten in place: the
+ * existing mappings then keep the old contents.
+ */
+class MappedFile {
+  std::string _filename;
+  void* _base = nullptr;
+  size_t _size = 0;
+
+ public:
+  // Throws std::runtime_error if the file cannot be opened or mapped
+  MappedFile(const std::string& filename);
+  MappedFile(const MappedFile &src) = delete;
+  MappedFile& operator=(const MappedFile &src) = delete;
+  ~MappedFile();
+
+  const char* data() const { return static_cast<const char*>(_base); };
+  size_t size() const { return _size; };
+  const std::string& filename() const { return _filename; };
+};
+
+#endif  //MAPPED_FILE_H
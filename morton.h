@@ -0,0 +1,26 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+
+// Spreads the 21 low bits of v so that bit b moves to bit 3b
+inline uint64_t mortonSpread(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | (v << 32)) & 0x1f00000000ffffULL;
+  v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+  v = (v | (v << 8))  & 0x100f00f00f00f00fULL;
+  v = (v | (v << 4))  & 0x10c30c30c30c30c3ULL;
+  v = (v | (v << 2))  & 0x1249249249249249ULL;
+  return v;
+}
+
+/**
+ * @brief Z-order (Morton) code of the lattice coordinates (i, j, k), each in [0, 2^21): their bits interleaved.
+ *
+ * Sorting points by code lays them out along the Z-order curve: points close in space are mostly close in memory.
+ */
+inline uint64_t mortonCode(uint64_t i, uint64_t j, uint64_t k) {
+  return (mortonSpread(i) << 2) | (mortonSpread(j) << 1) | mortonSpread(k);
+}
+
+#endif  //MORTON_H
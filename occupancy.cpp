@@ -0,0 +1,25 @@
+#include "occupancy.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+Occupancy::Occupancy(std::array<long,3> lo, std::array<long,3> hi) :
+                _lo{lo} {
+  size_t nWords = 1;
+  for (int d = 0; d < 3; ++d) {
+    _n[d] = hi[d] >= lo[d] ? hi[d] - lo[d] + 1 : 0;
+    _bricks[d] = (_n[d] + 3) / 4;
+    nWords *= _bricks[d];
+  }
+  _words.assign(std::max<size_t>(nWords, 1), 0);
+}
+
+void Occupancy::set(long i, long j, long k) {
+  uint64_t a = i - _lo[0], b = j - _lo[1], c = k - _lo[2];
+  if (a >= _n[0] || b >= _n[1] || c >= _n[2]) {
+    throw std::runtime_error("Occupancy::set: (" + std::to_string(i) + ", " + std::to_string(j) + ", " +
+                             std::to_string(k) + ") is outside the box.");
+  }
+  uint64_t word = ((a >> 2)*_bricks[1] + (b >> 2))*_bricks[2] + (c >> 2);
+  _words[word] |= uint64_t(1) << (((a & 3) << 4) | ((b & 3) << 2) | (c & 3));
+}
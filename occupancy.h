@@ -0,0 +1,80 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief One bit per lattice point of a box: is the point occupied (e.g. in the band)?
+ *
+ * The bits are grouped in 4^3 bricks, one uint64 each, so that the neighbours of a point mostly share its word and
+ * empty regions are skipped a brick at a time. At 1 bit per lattice point, a 1000^3 box takes 125 MB.
+ */
+class Occupancy {
+  std::array<long,3> _lo = {0, 0, 0};      // lowest lattice point of the box
+  std::array<uint64_t,3> _n = {0, 0, 0};   // lattice points along each axis
+  std::array<uint64_t,3> _bricks = {0, 0, 0};
+  std::vector<uint64_t> _words = {0};      // never empty: out of the box queries read word 0
+
+ public:
+  Occupancy() = default;
+  // Empty box of the lattice points lo <= (i,j,k) <= hi
+  Occupancy(std::array<long,3> lo, std::array<long,3> hi);
+
+  // Marks (i,j,k) as occupied, throws if it is outside the box
+  void set(long i, long j, long k);
+
+  // Whether (i,j,k) is occupied (false outside the box), without branches
+  bool contains(long i, long j, long k) const {
+    uint64_t a = i - _lo[0], b = j - _lo[1], c = k - _lo[2];   // below the box wraps around to large values
+    uint64_t inside = (a < _n[0]) & (b < _n[1]) & (c < _n[2]);
+    uint64_t word = inside*(((a >> 2)*_bricks[1] + (b >> 2))*_bricks[2] + (c >> 2));
+    return (_words[word] >> (((a & 3) << 4) | ((b & 3) << 2) | (c & 3))) & inside;
+  };
+
+  /**
+   * @brief Occupied lattice point nearest to (u,v,w), given in lattice units (x/h...), within `maxRadius` lattice
+   * points along each axis of the nearest lattice point.
+   *
+   * Shells of increasing radius are searched until no farther shell can hold a closer point. Returns false if that
+   * cannot be established within maxRadius. `better(candidate, best)` breaks ties between points at the same distance.
+   */
+  template<typename TieBreak>
+  bool nearest(double u, double v, double w, int maxRadius, std::array<long,3>& out, TieBreak better) const;
+
+  size_t memoryBytes() const { return _words.size()*sizeof(uint64_t); };
+};
+
+template<typename TieBreak>
+bool Occupancy::nearest(double u, double v, double w, int maxRadius, std::array<long,3>& out, TieBreak better) const {
+  const long ci = std::lround(u), cj = std::lround(v), ck = std::lround(w);
+  double best = -1;
+  for (long r = 0; r <= maxRadius; ++r) {
+    for (long i = ci - r; i <= ci + r; ++i) {
+      for (long j = cj - r; j <= cj + r; ++j) {
+        // only the shell: the whole range of k on its faces, its two ends elsewhere
+        bool face = i == ci - r || i == ci + r || j == cj - r || j == cj + r;
+        for (long k = ck - r; k <= ck + r; k += face || r == 0 ? 1 : 2*r) {
+          if (!contains(i, j, k))
+            continue;
+          double d = (i - u)*(i - u) + (j - v)*(j - v) + (k - w)*(k - w);
+          std::array<long,3> candidate = {i, j, k};
+          if (best < 0 || d < best || (d == best && better(candidate, out))) {
+            best = d;
+            out = candidate;
+          }
+        }
+      }
+    }
+    // points of the next shells are at least r + 0.5 away
+    if (best >= 0 && best < (r + 0.5)*(r + 0.5))
+      return true;
+  }
+  // a point beyond maxRadius could still be closer than the best one found
+  return false;
+}
+
+#endif  //OCCUPANCY_H
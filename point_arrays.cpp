@@ -0,0 +1,78 @@
+#include "point_arrays.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+void PointArrays::allocate(size_t n) {
+  constexpr size_t PER_LINE = ALIGNMENT/sizeof(double);
+  _size = n;
+  _stride = (n + PER_LINE - 1) / PER_LINE * PER_LINE;
+  _base = nullptr;
+  if (_stride > 0) {
+    _base = static_cast<double*>(std::aligned_alloc(ALIGNMENT, 3*_stride*sizeof(double)));
+    if (_base == nullptr)
+      throw std::bad_alloc();
+  }
+}
+
+PointArrays::PointArrays(size_t n, Point value) {
+  allocate(n);
+  std::fill(x(), x() + n, value.x);
+  std::fill(y(), y() + n, value.y);
+  std::fill(z(), z() + n, value.z);
+}
+
+PointArrays::PointArrays(const Point *points, size_t n) {
+  allocate(n);
+  for (size_t i = 0; i < n; ++i)
+    (*this)[i] = points[i];
+}
+
+PointArrays::PointArrays(const PointArrays &src) {
+  allocate(src._size);
+  std::copy(src._base, src._base + 3*_stride, _base);
+}
+
+PointArrays::PointArrays(PointArrays &&src) :
+                _size{src._size},
+                _stride{src._stride},
+                _base{src._base} {
+  src._size = 0;
+  src._stride = 0;
+  src._base = nullptr;
+}
+
+PointArrays &PointArrays::operator=(const PointArrays &src) {
+  if (this != &src)
+    *this = PointArrays(src);
+  return *this;
+}
+
+PointArrays &PointArrays::operator=(PointArrays &&src) {
+  if (this == &src)
+    return *this;
+  std::free(_base);
+  _size = src._size;
+  _stride = src._stride;
+  _base = src._base;
+  src._size = 0;
+  src._stride = 0;
+  src._base = nullptr;
+  return *this;
+}
+
+PointArrays::~PointArrays() {
+  std::free(_base);
+}
+
+void PointArrays::copyTo(Point *out) const {
+  const double *px = x(), *py = y(), *pz = z();
+  for (size_t i = 0; i < _size; ++i)
+    out[i] = {px[i], py[i], pz[i]};
+}
+
+std::vector<Point> PointArrays::points() const {
+  std::vector<Point> result(_size);
+  copyTo(result.data());
+  return result;
+}
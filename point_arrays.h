@@ -0,0 +1,62 @@
+#ifndef POINT_ARRAYS_H
+#define POINT_ARRAYS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * @brief Points stored as a structure of arrays: separate x, y and z arrays, each 64-byte aligned.
+ *
+ * Kernels applying the same operation to many points (projection, snapping, statistics) can then use full SIMD
+ * loads of consecutive coordinates. operator[] keeps the Point-style access of arrays of Point: the const version
+ * returns a Point, the other a Reference whose x, y and z members refer to the stored coordinates, so that
+ * `walkers[w].x += stepSize` and `walkers[w] = surf.project(walkers[w])` work unchanged.
+ */
+class PointArrays {
+  size_t _size = 0;
+  size_t _stride = 0;       // doubles between the x, y and z arrays, a multiple of ALIGNMENT/sizeof(double)
+  double* _base = nullptr;  // one allocation: the x array, then the y array, then the z array
+
+  void allocate(size_t n);
+
+ public:
+  static constexpr size_t ALIGNMENT = 64;
+
+  struct Reference {
+    double& x;
+    double& y;
+    double& z;
+
+    operator Point() const { return {x, y, z}; };
+    Reference& operator=(Point p) { x = p.x; y = p.y; z = p.z; return *this; };
+    Reference& operator=(const Reference& r) { return *this = Point(r); };
+  };
+
+  PointArrays(size_t n = 0, Point value = Point{});
+  PointArrays(const Point* points, size_t n);
+
+  PointArrays(const PointArrays &src);
+  PointArrays(PointArrays &&src);
+  PointArrays& operator=(const PointArrays &src);
+  PointArrays& operator=(PointArrays &&src);
+  ~PointArrays();
+
+  size_t size() const { return _size; };
+  Point operator[](size_t i) const { return {_base[i], _base[_stride + i], _base[2*_stride + i]}; };
+  Reference operator[](size_t i) { return {_base[i], _base[_stride + i], _base[2*_stride + i]}; };
+
+  double* x() { return _base; };
+  double* y() { return _base + _stride; };
+  double* z() { return _base + 2*_stride; };
+  const double* x() const { return _base; };
+  const double* y() const { return _base + _stride; };
+  const double* z() const { return _base + 2*_stride; };
+
+  // Copies the points, as an array of Point, to out[0..size)
+  void copyTo(Point* out) const;
+  std::vector<Point> points() const;
+};
+
+#endif  //POINT_ARRAYS_H
@@ -0,0 +1,51 @@
+#include "result_cache.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+ResultCache::ResultCache(std::string root) :
+                _root{std::move(root)} {
+}
+
+std::string ResultCache::hash(const std::string &key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+  return hex;
+}
+
+std::string ResultCache::directory(const std::string &key) const {
+  return (std::filesystem::path(_root) / hash(key)).string();
+}
+
+bool ResultCache::completed(const std::string &key) const {
+  std::ifstream in(std::filesystem::path(directory(key)) / MARKER);
+  if (!in)
+    return false;
+  std::stringstream stored;
+  stored << in.rdbuf();
+  if (stored.str() != key + "\n") {
+    throw std::runtime_error("ResultCache::completed: " + directory(key) + " holds the results of another run.");
+  }
+  return true;
+}
+
+void ResultCache::markCompleted(const std::string &key) const {
+  std::filesystem::path dir = directory(key);
+  std::filesystem::create_directories(dir);
+  std::filesystem::path tmp = dir / (std::string(MARKER) + ".tmp");
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    out << key << '\n';
+    if (!out) {
+      throw std::runtime_error("ResultCache::markCompleted: cannot write " + tmp.string() + ".");
+    }
+  }
+  std::filesystem::rename(tmp, dir / MARKER);
+}
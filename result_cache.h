@@ -0,0 +1,42 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Content-addressed store of run results.
+ *
+ * A run is identified by a canonical key string listing everything its outputs depend on (surface, parameters,
+ * seed, output options). Its outputs live in `root`/<hash of the key>/, and a completion marker holding the key is
+ * written there once the run has finished: runs whose marker exists are skipped when a sweep is run again or
+ * extended, so only the new points of the parameter space are simulated.
+ */
+class ResultCache {
+  std::string _root;
+
+ public:
+  static constexpr const char* MARKER = "complete";
+
+  ResultCache(std::string root);
+
+  // 64 bit FNV-1a hash of the key, as 16 hex digits
+  static std::string hash(const std::string& key);
+
+  // Directory of the outputs of the run `key`
+  std::string directory(const std::string& key) const;
+
+  /**
+   * @brief Whether the run `key` has completed.
+   *
+   * Throws std::runtime_error if the directory of `key` holds the marker of a different key (a hash collision).
+   */
+  bool completed(const std::string& key) const;
+
+  // Writes the completion marker of `key` (atomically, by renaming a temporary file)
+  void markCompleted(const std::string& key) const;
+
+  const std::string& root() const { return _root; };
+};
+
+#endif  //RESULT_CACHE_H
@@ -0,0 +1,218 @@
+#include "run_file.h"
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+using namespace runfile;
+
+RunFileWriter::RunFileWriter(const std::string &filename) {
+  create(filename);
+}
+
+void RunFileWriter::create(const std::string &filename) {
+  _out.open(filename, std::ios::binary | std::ios::trunc);
+  if (!_out) {
+    throw std::runtime_error("RunFileWriter: cannot open " + filename + ".");
+  }
+  FileHeader header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = 1;
+  _out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  _offset = sizeof(header);
+}
+
+RunFileWriter::RunFileWriter(const std::string &filename, int64_t resumeStep) {
+  if (!std::filesystem::exists(filename)) {
+    create(filename);
+    return;
+  }
+
+  // keep the parameters and the snapshots before resumeStep, records are in file order
+  uint64_t end = sizeof(FileHeader);
+  {
+    RunFileReader reader(filename);
+    for (auto const& entry : reader.index()) {
+      if (entry.kind == Final || (entry.kind == Snapshot && entry.step >= resumeStep))
+        break;
+      _index.push_back(entry);
+      end = entry.offset + (entry.kind == Parameters ? entry.nItems : entry.nItems*sizeof(Point));
+    }
+  }
+  std::filesystem::resize_file(filename, end);
+
+  _out.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+  if (!_out) {
+    throw std::runtime_error("RunFileWriter: cannot open " + filename + ".");
+  }
+  _out.seekp(end);
+  _offset = end;
+}
+
+RunFileWriter::~RunFileWriter() {
+  if (_out.is_open())
+    close();
+}
+
+void RunFileWriter::append(Kind kind, int64_t step, const char *payload, uint64_t nItems, uint64_t bytes) {
+  if (!_out.is_open()) {
+    throw std::runtime_error("RunFileWriter: cannot append to a closed run file.");
+  }
+  RecordHeader record{kind, 0, step, nItems};
+  _out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+  _out.write(payload, bytes);
+  if (!_out) {
+    throw std::runtime_error("RunFileWriter: write failed.");
+  }
+  _index.push_back({kind, 0, step, _offset + sizeof(record), nItems});
+  _offset += sizeof(record) + bytes;
+}
+
+void RunFileWriter::writeParameters(const std::map<std::string, std::string> &parameters) {
+  std::string text;
+  for (auto const& [key, value] : parameters) {
+    text += key + '=' + value + '\n';
+  }
+  append(Parameters, -1, text.data(), text.size(), text.size());
+}
+
+void RunFileWriter::writeSnapshot(int64_t step, const Point *points, uint64_t n) {
+  append(Snapshot, step, reinterpret_cast<const char*>(points), n, n*sizeof(Point));
+}
+
+void RunFileWriter::writeFinal(int64_t step, const Point *points, uint64_t n) {
+  append(Final, step, reinterpret_cast<const char*>(points), n, n*sizeof(Point));
+}
+
+void RunFileWriter::flush() {
+  _out.flush();
+}
+
+void RunFileWriter::close() {
+  Footer footer{_offset, _index.size(), {}};
+  std::memcpy(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  _out.write(reinterpret_cast<const char*>(_index.data()), _index.size()*sizeof(IndexEntry));
+  _out.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  _out.close();
+}
+
+
+RunFileReader::RunFileReader(const std::string &filename) :
+                _filename{filename},
+                _in{filename, std::ios::binary} {
+  if (!_in) {
+    throw std::runtime_error("RunFileReader: cannot open " + filename + ".");
+  }
+  FileHeader header{};
+  _in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!_in || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("RunFileReader: " + filename + " is not a run file.");
+  }
+
+  _in.seekg(0, std::ios::end);
+  uint64_t size = _in.tellg();
+
+  // Closed file: read the index pointed to by the footer
+  Footer footer{};
+  if (size >= sizeof(header) + sizeof(footer)) {
+    _in.seekg(size - sizeof(footer));
+    _in.read(reinterpret_cast<char*>(&footer), sizeof(footer));
+    if (_in && std::memcmp(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+        && footer.indexOffset + footer.count*sizeof(IndexEntry) + sizeof(footer) == size) {
+      _index.resize(footer.count);
+      _in.seekg(footer.indexOffset);
+      _in.read(reinterpret_cast<char*>(_index.data()), footer.count*sizeof(IndexEntry));
+      _complete = true;
+      return;
+    }
+  }
+
+  // Interrupted writer: recover what was fully written
+  _in.clear();
+  scanRecords(size);
+}
+
+void RunFileReader::scanRecords(uint64_t end) {
+  uint64_t offset = sizeof(FileHeader);
+  RecordHeader record{};
+  while (offset + sizeof(record) <= end) {
+    _in.seekg(offset);
+    _in.read(reinterpret_cast<char*>(&record), sizeof(record));
+    if (!_in || record.kind < Snapshot || record.kind > Parameters)
+      break;
+    uint64_t bytes = record.kind == Parameters ? record.nItems : record.nItems*sizeof(Point);
+    if (offset + sizeof(record) + bytes > end)
+      break;      // truncated record
+    _index.push_back({record.kind, 0, record.step, offset + sizeof(record), record.nItems});
+    offset += sizeof(record) + bytes;
+  }
+  _in.clear();
+}
+
+std::vector<int64_t> RunFileReader::steps() const {
+  std::vector<int64_t> result;
+  for (auto const& entry : _index) {
+    if (entry.kind == Snapshot)
+      result.push_back(entry.step);
+  }
+  return result;
+}
+
+const IndexEntry* RunFileReader::find(Kind kind, int64_t step) const {
+  for (auto const& entry : _index) {
+    if (entry.kind == kind && (kind != Snapshot || entry.step == step))
+      return &entry;
+  }
+  return nullptr;
+}
+
+std::vector<Point> RunFileReader::readPoints(const IndexEntry &entry) {
+  std::vector<Point> points(entry.nItems);
+  _in.seekg(entry.offset);
+  _in.read(reinterpret_cast<char*>(points.data()), entry.nItems*sizeof(Point));
+  if (!_in) {
+    throw std::runtime_error("RunFileReader: cannot read " + _filename + ".");
+  }
+  return points;
+}
+
+std::vector<Point> RunFileReader::readStep(int64_t step) {
+  const IndexEntry* entry = find(Snapshot, step);
+  if (entry == nullptr) {
+    throw std::runtime_error("RunFileReader::readStep: step " + std::to_string(step) + " not in " + _filename + ".");
+  }
+  return readPoints(*entry);
+}
+
+std::vector<Point> RunFileReader::finalPositions() {
+  const IndexEntry* entry = find(Final, 0);
+  if (entry == nullptr) {
+    throw std::runtime_error("RunFileReader::finalPositions: " + _filename + " has no final positions.");
+  }
+  return readPoints(*entry);
+}
+
+int64_t RunFileReader::finalStep() const {
+  const IndexEntry* entry = find(Final, 0);
+  return entry == nullptr ? -1 : entry->step;
+}
+
+std::map<std::string, std::string> RunFileReader::parameters() {
+  std::map<std::string, std::string> result;
+  const IndexEntry* entry = find(Parameters, 0);
+  if (entry == nullptr)
+    return result;
+
+  std::string text(entry->nItems, '\0');
+  _in.seekg(entry->offset);
+  _in.read(text.data(), text.size());
+
+  std::istringstream lines(text);
+  std::string line;
+  while (std::getline(lines, line)) {
+    size_t eq = line.find('=');
+    if (eq != std::string::npos)
+      result[line.substr(0, eq)] = line.substr(eq + 1);
+  }
+  return result;
+}
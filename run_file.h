@@ -0,0 +1,130 @@
+#ifndef RUN_FILE_H
+#define RUN_FILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+/*
+ * Single-file container for all the snapshots of a run (.rwrun).
+ *
+ * Layout (little endian):
+ *   FileHeader
+ *   records, appended one after the other: RecordHeader followed by its payload
+ *     - Snapshot / Final: nItems points, 3 doubles each (x y z)
+ *     - Parameters:       nItems bytes of "key=value\n" text
+ *   IndexEntry[count]     written by close()
+ *   Footer                points back to the index
+ *
+ * The index is only a shortcut: a file whose writer was interrupted has no footer, and the reader rebuilds the
+ * index by walking the records from the start.
+ */
+namespace runfile {
+  constexpr char MAGIC[8] = {'R','W','R','U','N','0','0','1'};
+  constexpr char INDEX_MAGIC[8] = {'R','W','R','U','N','I','D','X'};
+
+  enum Kind : uint32_t {
+    Snapshot = 1,
+    Final = 2,
+    Parameters = 3
+  };
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+  struct RecordHeader {
+    uint32_t kind;
+    uint32_t reserved;
+    int64_t step;
+    uint64_t nItems;
+  };
+
+  struct IndexEntry {
+    uint32_t kind;
+    uint32_t reserved;
+    int64_t step;
+    uint64_t offset;    // offset of the payload (just after the RecordHeader)
+    uint64_t nItems;
+  };
+
+  struct Footer {
+    uint64_t indexOffset;
+    uint64_t count;
+    char magic[8];
+  };
+
+  static_assert(sizeof(Point) == 3*sizeof(double), "Point is written to disk as three packed doubles");
+}
+
+class RunFileWriter {
+  std::ofstream _out;
+  uint64_t _offset = 0;
+  std::vector<runfile::IndexEntry> _index;
+
+  void create(const std::string& filename);
+  void append(runfile::Kind kind, int64_t step, const char* payload, uint64_t nItems, uint64_t bytes);
+
+ public:
+  // Creates (or truncates) the run file `filename`
+  RunFileWriter(const std::string& filename);
+
+  /**
+   * @brief Reopens the run file `filename` to continue a run from `resumeStep`.
+   *
+   * Records of snapshots at steps >= resumeStep, final positions and the index are dropped from the file, which is
+   * truncated after the last record kept. If the file does not exist, a new one is created.
+   */
+  RunFileWriter(const std::string& filename, int64_t resumeStep);
+  RunFileWriter(const RunFileWriter &src) = delete;
+  RunFileWriter& operator=(const RunFileWriter &src) = delete;
+  ~RunFileWriter();                        // closes the file, writing the index
+
+  void writeParameters(const std::map<std::string, std::string>& parameters);
+  void writeSnapshot(int64_t step, const Point* points, uint64_t n);
+  void writeFinal(int64_t step, const Point* points, uint64_t n);
+
+  // Records written so far, including those kept when resuming
+  const std::vector<runfile::IndexEntry>& index() const { return _index; };
+
+  // Hand the buffered records to the OS, so that readers (and a resumed run) see them
+  void flush();
+
+  // Write the trailing index and close the file. Nothing can be appended afterwards
+  void close();
+};
+
+class RunFileReader {
+  std::string _filename;
+  std::ifstream _in;
+  std::vector<runfile::IndexEntry> _index;
+  bool _complete = false;
+
+  std::vector<Point> readPoints(const runfile::IndexEntry& entry);
+  const runfile::IndexEntry* find(runfile::Kind kind, int64_t step) const;
+  void scanRecords(uint64_t end);
+
+ public:
+  RunFileReader(const std::string& filename);
+
+  // Whether the file was closed properly (false if the index had to be rebuilt)
+  bool complete() const { return _complete; };
+
+  // Steps of the stored snapshots, in the order they were written
+  std::vector<int64_t> steps() const;
+  const std::vector<runfile::IndexEntry>& index() const { return _index; };
+
+  // Positions at snapshot `step`. Throws if the step was not logged
+  std::vector<Point> readStep(int64_t step);
+  std::vector<Point> finalPositions();
+  int64_t finalStep() const;
+  std::map<std::string, std::string> parameters();
+};
+
+#endif  //RUN_FILE_H
@@ -0,0 +1,340 @@
+#include "simulation.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "text_writer.h"
+#include "run_file.h"
+#include "checkpoint.h"
+#include "statistics.h"
+#include "manifest.h"
+#include "point_arrays.h"
+#include "spatial_sort.h"
+
+bool simulate(Surface const& surf, Point startingPoint, double stepSize, int nSteps,
+              bool snap, int nWalkers, OutputOptions output, CheckpointOptions checkpoint, uint64_t seed,
+              int sortEvery) {
+
+  // on the heap: runs of a sweep (see sweep.h) execute on threads with small stacks
+  // the walkers move as a structure of arrays; `positions` is their array of Point copy, for the outputs
+  PointArrays walkers(nWalkers, startingPoint);
+  std::vector<Point> positions(nWalkers, startingPoint);
+  // walker in each slot of `walkers`, reordered by sortByCell; `positions` is always in walker order
+  std::vector<int> ids(nWalkers);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::vector<uint8_t> directions(nWalkers);
+  auto gatherPositions = [&]() {
+    for (int s = 0; s < nWalkers; ++s)
+      positions[ids[s]] = walkers[s];
+  };
+
+  std::random_device dev;
+  std::seed_seq seedSequence{uint32_t(seed), uint32_t(seed >> 32)};
+  std::mt19937 rng = seed == 0 ? std::mt19937(dev()) : std::mt19937(seedSequence);
+  std::uniform_int_distribution<std::mt19937::result_type> dist(0,5); // distribution in range [0,5]
+
+  auto makeCheckpoint = [&](int step) {
+    std::ostringstream rngState;
+    rngState << rng << ' ' << dist;
+    gatherPositions();
+    return Checkpoint{stepSize, nSteps, snap, nWalkers, startingPoint, step, rngState.str(), positions};
+  };
+
+  // Restore the state of an interrupted run
+  int firstStep = 0;
+  if (checkpoint.resume && !checkpoint.file.empty() && std::filesystem::exists(checkpoint.file)) {
+    Checkpoint saved = loadCheckpoint(checkpoint.file);
+    Point p = saved.startingPoint;
+    if (saved.stepSize != stepSize || saved.nWalkers != nWalkers || saved.snap != snap ||
+        p.x != startingPoint.x || p.y != startingPoint.y || p.z != startingPoint.z) {
+      throw std::runtime_error("simulate: checkpoint " + checkpoint.file + " was written by a run with different parameters.");
+    }
+    if (saved.step >= nSteps) {
+      std::cout << "Simulation already completed: step size " << stepSize << ", skipping.\n";
+      return true;
+    }
+    walkers = PointArrays(saved.walkers.data(), nWalkers);
+    std::istringstream rngState(saved.rngState);
+    rngState >> rng >> dist;
+    firstStep = saved.step;
+    std::cout << "Resuming simulation from step " << firstStep << ".\n";
+  }
+
+  std::unique_ptr<CheckpointWriter> checkpointWriter;
+  if (!checkpoint.file.empty())
+    checkpointWriter = std::make_unique<CheckpointWriter>(checkpoint.file);
+
+  // only a fixed subset of the walkers is written to the snapshots, all of them keep moving
+  std::vector<int> logged = loggedWalkers(nWalkers, output.nLogged);
+  std::vector<Point> loggedPositions(logged.size());
+  auto gatherLogged = [&]() -> const Point* {
+    if ((int)logged.size() == nWalkers)
+      return positions.data();
+    for (size_t i = 0; i < logged.size(); ++i)
+      loggedPositions[i] = positions[logged[i]];
+    return loggedPositions.data();
+  };
+
+  std::unique_ptr<RunFileWriter> runFile;
+  if (output.format == OutputFormat::RunFile && firstStep > 0) {
+    runFile = std::make_unique<RunFileWriter>(output.dir + ".rwrun", firstStep);
+  } else if (output.format == OutputFormat::RunFile) {
+    std::filesystem::path runPath = output.dir + ".rwrun";
+    if (runPath.has_parent_path())
+      std::filesystem::create_directories(runPath.parent_path());
+    runFile = std::make_unique<RunFileWriter>(runPath.string());
+    runFile->writeParameters({
+      {"stepSize", std::to_string(stepSize)},
+      {"nSteps", std::to_string(nSteps)},
+      {"snap", std::to_string(snap)},
+      {"nWalkers", std::to_string(nWalkers)},
+      {"startingPoint", std::to_string(startingPoint.x) + " " + std::to_string(startingPoint.y) + " " + std::to_string(startingPoint.z)},
+      {"surfacePoints", std::to_string(surf.nPoints())},
+      {"logSchedule", output.schedule.describe()},
+      {"nLogged", std::to_string(logged.size())}
+    });
+  } else if (output.format == OutputFormat::Text) {
+    // create output directory recursively
+    std::filesystem::create_directories(output.dir);
+  }
+
+  // in-situ statistics, computed over all the walkers
+  std::unique_ptr<StepTable> varianceTable;
+  if (output.variance) {
+    std::filesystem::path tablePath = output.dir + "_variance.csv";
+    if (tablePath.has_parent_path())
+      std::filesystem::create_directories(tablePath.parent_path());
+    varianceTable = std::make_unique<StepTable>(tablePath.string(), std::vector<std::string>{"variance"}, firstStep);
+  }
+  std::unique_ptr<StepTable> momentsTable;
+  std::unique_ptr<MomentsLog> momentsLog;
+  if (output.moments) {
+    std::vector<std::string> columns = {"n"};
+    for (auto const& name : EnsembleMoments::names()) {
+      for (auto suffix : {"_mean", "_se", "_ci95", "_skewness", "_kurtosis"})
+        columns.push_back(name + suffix);
+    }
+    std::filesystem::path tablePath = output.dir + "_moments.csv";
+    if (tablePath.has_parent_path())
+      std::filesystem::create_directories(tablePath.parent_path());
+    momentsTable = std::make_unique<StepTable>(tablePath.string(), columns, firstStep);
+    momentsLog = std::make_unique<MomentsLog>(output.dir + "_moments.bin", firstStep);
+  }
+
+  std::unique_ptr<DensityLog> densityLog;
+  if (output.density != nullptr) {
+    std::filesystem::path logPath = output.dir + "_density.bin";
+    if (logPath.has_parent_path())
+      std::filesystem::create_directories(logPath.parent_path());
+    densityLog = std::make_unique<DensityLog>(logPath.string(), *output.density, firstStep);
+  }
+
+  std::unique_ptr<StepTable> geodesicTable;
+  if (output.geodesic != nullptr) {
+    std::filesystem::path tablePath = output.dir + "_geodesic.csv";
+    if (tablePath.has_parent_path())
+      std::filesystem::create_directories(tablePath.parent_path());
+    geodesicTable = std::make_unique<StepTable>(tablePath.string(),
+                                                std::vector<std::string>{"mean_distance", "mean_squared_distance"}, firstStep);
+  }
+
+  // manifest of the run (see manifest.h), rewritten whenever the outputs are flushed
+  auto started = std::chrono::steady_clock::now();
+  std::string formatName = output.format == OutputFormat::Text ? "text" : output.format == OutputFormat::RunFile ? "run" : "none";
+  RunManifest manifest(output.dir + "_manifest.json", formatName);
+  manifest.parameter("stepSize", stepSize);
+  manifest.parameter("nSteps", int64_t(nSteps));
+  manifest.parameter("snap", int64_t(snap));
+  manifest.parameter("nWalkers", int64_t(nWalkers));
+  manifest.parameter("startingPoint", startingPoint);
+  manifest.parameter("centre", output.centre);
+  manifest.parameter("logSchedule", output.schedule.describe());
+  manifest.parameter("nLogged", int64_t(logged.size()));
+  manifest.parameter("seed", std::to_string(seed));
+  manifest.surface(output.surface, surf.nPoints(), surf.h());
+  manifest.timing("started", isoTime());
+  manifest.timing("firstStep", double(firstStep));
+  if (runFile)
+    manifest.output("run", output.dir + ".rwrun");
+  if (varianceTable)
+    manifest.output("variance", output.dir + "_variance.csv");
+  if (momentsTable) {
+    manifest.output("moments", output.dir + "_moments.csv");
+    manifest.output("momentsStates", output.dir + "_moments.bin");
+  }
+  if (densityLog)
+    manifest.output("density", output.dir + "_density.bin");
+  if (geodesicTable)
+    manifest.output("geodesic", output.dir + "_geodesic.csv");
+  if (!checkpoint.file.empty())
+    manifest.output("checkpoint", checkpoint.file);
+
+  auto addRunFileSnapshot = [&](const runfile::IndexEntry& entry) {
+    manifest.snapshot(entry.step, output.dir + ".rwrun", entry.offset, entry.nItems*sizeof(Point), entry.nItems,
+                      entry.kind == runfile::Kind::Final);
+  };
+  auto addTextSnapshot = [&](int step, const std::string& filename, bool final) {
+    manifest.snapshot(step, filename, 0, std::filesystem::file_size(filename), final ? nWalkers : logged.size(), final);
+  };
+  // snapshots written before the run was interrupted
+  if (runFile) {
+    for (auto const& entry : runFile->index()) {
+      if (entry.kind == runfile::Kind::Snapshot)
+        addRunFileSnapshot(entry);
+    }
+  } else if (output.format == OutputFormat::Text) {
+    for (int step = 0; step < firstStep; ++step) {
+      std::string filename = output.dir + "/step" + std::to_string(step) + ".dat";
+      if (output.schedule.contains(step) && std::filesystem::exists(filename))
+        addTextSnapshot(step, filename, false);
+    }
+  }
+  auto writeManifest = [&](bool completed, int step) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    manifest.timing("wallSeconds", seconds);
+    manifest.timing("stepsPerSecond", seconds > 0 ? (step - firstStep) / seconds : 0);
+    manifest.write(completed, step);
+  };
+  {
+    std::filesystem::path manifestPath = output.dir + "_manifest.json";
+    if (manifestPath.has_parent_path())
+      std::filesystem::create_directories(manifestPath.parent_path());
+  }
+  writeManifest(false, firstStep);
+
+  // positions must be up to date (gatherPositions) before logging statistics or snapshots
+  const Point* current = positions.data();
+  auto logStatistics = [&](int step) {
+    if (varianceTable)
+      varianceTable->write(step, {geodesicVariance(current, nWalkers, startingPoint, output.centre)});
+    if (momentsTable) {
+      EnsembleMoments moments = ensembleMoments(current, nWalkers, startingPoint, output.centre);
+      std::vector<double> row = {double(nWalkers)};
+      for (const Moments* m : moments.all()) {
+        row.insert(row.end(), {m->mean(), m->standardError(), m->confidence(), m->skewness(), m->kurtosis()});
+      }
+      momentsTable->write(step, row);
+      momentsLog->write(step, moments);
+    }
+    if (densityLog)
+      densityLog->write(step, output.density->histogram(current, nWalkers));
+    if (geodesicTable) {
+      double mean, meanSquared;
+      output.geodesic->moments(current, nWalkers, mean, meanSquared);
+      geodesicTable->write(step, {mean, meanSquared});
+    }
+  };
+  auto flushStatistics = [&]() {
+    if (varianceTable)
+      varianceTable->flush();
+    if (momentsTable) {
+      momentsTable->flush();
+      momentsLog->flush();
+    }
+    if (densityLog)
+      densityLog->flush();
+    if (geodesicTable)
+      geodesicTable->flush();
+  };
+
+  for (int step = firstStep; step < nSteps; ++step) {
+    // Checkpoints are taken before logging: a resumed run starts by logging `step` again
+    if (checkpointWriter && checkpoint.every > 0 && step > firstStep && step % checkpoint.every == 0) {
+      if (runFile)
+        runFile->flush();
+      flushStatistics();
+      writeManifest(false, step);
+      checkpointWriter->submit(makeCheckpoint(step));
+    }
+    if (stopRequested()) {
+      if (checkpointWriter) {
+        if (runFile)
+          runFile->flush();
+        flushStatistics();
+        writeManifest(false, step);
+        checkpointWriter->flush();
+        saveCheckpoint(checkpoint.file, makeCheckpoint(step));
+      }
+      std::cout << "Simulation stopped at step " << step << ", step size " << stepSize << ".\n";
+      return false;
+    }
+
+    // log positions (by default every 10 steps)
+    if (output.schedule.contains(step)) {
+      gatherPositions();
+      const Point* snapshot = gatherLogged();
+      logStatistics(step);
+      if (runFile) {
+        runFile->writeSnapshot(step, snapshot, logged.size());
+        addRunFileSnapshot(runFile->index().back());
+      } else if (output.format == OutputFormat::Text) {
+        std::string filename = output.dir + "/step" + std::to_string(step) + ".dat";
+        writePointsText(filename, snapshot, logged.size());
+        addTextSnapshot(step, filename, false);
+      }
+
+      // publish to live viewers
+      if (output.ring != nullptr)
+        output.ring->publish(step, snapshot, logged.size());
+    }
+
+    if (sortEvery > 0 && surf.h() > 0 && step % sortEvery == 0)
+      sortByCell(walkers, ids, surf.h());
+
+    // chose a random direction (up, down, left, right, forward, backward) for each walker, in walker order
+    for (int w = 0; w < nWalkers; ++w)
+      directions[w] = dist(rng);
+
+    for (int w = 0; w < nWalkers; ++w) {
+      int direction = directions[ids[w]];
+
+      switch(direction) {
+        case 0: walkers[w].x += stepSize; break; //right
+        case 1: walkers[w].x -= stepSize; break; //left
+        case 2: walkers[w].y += stepSize; break; //up
+        case 3: walkers[w].y -= stepSize; break; //down
+        case 4: walkers[w].z += stepSize; break; //forward
+        case 5: walkers[w].z -= stepSize; break; //backward
+      }
+
+      // project back to the surface
+      walkers[w] = surf.project(walkers[w]);
+
+      // optionally, snap to nearest point
+      if (snap)
+        walkers[w] = surf.snap(walkers[w]);
+    }
+  }
+
+  // Log a final time
+  gatherPositions();
+  logStatistics(nSteps);
+  if (runFile) {
+    runFile->writeFinal(nSteps, current, nWalkers);
+    addRunFileSnapshot(runFile->index().back());
+    runFile->close();
+  } else if (output.format == OutputFormat::Text) {
+    // next to the run directory: runs of a sweep that share the step size must not overwrite each other
+    std::string filename = output.dir + "_step" + std::to_string(nSteps) + ".dat";
+    writePointsText(filename, current, nWalkers);
+    addTextSnapshot(nSteps, filename, true);
+  }
+  if (output.ring != nullptr)
+    output.ring->publish(nSteps, current, nWalkers);
+
+  // mark the run as completed, so that resuming skips it
+  if (checkpointWriter) {
+    checkpointWriter->flush();
+    saveCheckpoint(checkpoint.file, makeCheckpoint(nSteps));
+  }
+  flushStatistics();
+  writeManifest(true, nSteps);
+
+  std::cout << "Simulation completed: " << nWalkers << " walkers, " << nSteps << " steps each, step size " << stepSize << ".\n";
+  return true;
+}
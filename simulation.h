@@ -0,0 +1,58 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cstdint>
+#include <string>
+
+#include "surface.h"
+#include "snapshot_ring.h"
+#include "log_schedule.h"
+#include "density_map.h"
+#include "geodesic.h"
+
+enum class OutputFormat {
+  Text,     // one outputDir/stepN.dat text file per snapshot
+  RunFile,  // all the snapshots in a single outputDir.rwrun container (see run_file.h)
+  None      // no snapshots, only the in-situ statistics
+};
+
+// What simulate() writes, where and when
+struct OutputOptions {
+  std::string dir = "data";
+  OutputFormat format = OutputFormat::Text;
+  LogSchedule schedule = LogSchedule::every(10);
+  int nLogged = 0;                  // walkers written at each snapshot (see loggedWalkers), 0 for all
+  SnapshotRing* ring = nullptr;     // also publish the snapshots to live viewers
+  bool variance = false;            // write the geodesic variance at each logged step to dir_variance.csv
+  bool moments = false;             // write moments of positions, displacement and angle to dir_moments.csv/.bin
+  Point centre;                     // centre of the (sphere-like) surface, for the geodesic angles
+  const DensityMap* density = nullptr;  // write histograms of the walker positions to dir_density.bin
+  const GeodesicField* geodesic = nullptr;  // write mean and mean squared geodesic distance to dir_geodesic.csv
+  std::string surface;              // description of the surface, recorded in dir_manifest.json
+};
+
+// Periodic checkpoints of a run, see checkpoint.h
+struct CheckpointOptions {
+  std::string file;     // empty: no checkpoints
+  int every = 1000;     // steps between two checkpoints
+  bool resume = false;  // continue from `file`, if it exists
+};
+
+/**
+ * @brief Simulates nWalkers random walkers on `surf` for nSteps steps, writing the outputs described by `output`.
+ *
+ * Each step moves every walker by stepSize along a random lattice direction and projects it back onto the surface
+ * (then snaps it to the band lattice if `snap`). Runs only read `surf`, so concurrent runs can share it.
+ * A nonzero `seed` makes the run reproducible, 0 seeds the generator from std::random_device.
+ *
+ * With sortEvery > 0, the walkers are re-sorted in memory by lattice cell (sortByCell, cells of side h) every
+ * sortEvery steps, so that per-walker lookups into spatial tables follow memory order. The random directions are
+ * drawn in walker order and the outputs are written in walker order, so the results do not depend on sortEvery.
+ *
+ * @return false if the run was stopped by SIGTERM/SIGINT before completing (after writing a checkpoint).
+ */
+bool simulate(Surface const& surf, Point startingPoint, double stepSize, int nSteps,
+              bool snap = false, int nWalkers = 10000, OutputOptions output = {},
+              CheckpointOptions checkpoint = {}, uint64_t seed = 0, int sortEvery = 0);
+
+#endif  //SIMULATION_H
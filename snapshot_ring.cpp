@@ -0,0 +1,95 @@
+#include "snapshot_ring.h"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SnapshotRing::SnapshotRing(std::string name, int nSlots, int nWalkers) :
+                _name{name[0] == '/' ? name : "/" + name},
+                _nSlots{nSlots},
+                _nWalkers{nWalkers} {
+  if (nSlots <= 0 || nWalkers <= 0) {
+    throw std::runtime_error("SnapshotRing: number of slots and walkers must be positive.");
+  }
+
+  // keep every slot 64 byte aligned, so that headers never share a cache line with the previous frame
+  size_t frameBytes = sizeof(SlotHeader) + sizeof(double)*3*nWalkers;
+  size_t slotBytes = (frameBytes + 63) / 64 * 64;
+  size_t dataOffset = (sizeof(RingHeader) + 63) / 64 * 64;
+  _bytes = dataOffset + slotBytes*nSlots;
+
+  int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("SnapshotRing: cannot create shared memory segment " + _name + ".");
+  }
+  if (ftruncate(fd, _bytes) != 0) {
+    close(fd);
+    shm_unlink(_name.c_str());
+    throw std::runtime_error("SnapshotRing: cannot resize shared memory segment " + _name + ".");
+  }
+  _base = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (_base == MAP_FAILED) {
+    _base = nullptr;
+    shm_unlink(_name.c_str());
+    throw std::runtime_error("SnapshotRing: cannot map shared memory segment " + _name + ".");
+  }
+
+  char* bytes = static_cast<char*>(_base);
+  for (int s = 0; s < nSlots; ++s) {
+    SlotHeader* slot = new (bytes + dataOffset + slotBytes*s) SlotHeader;
+    slot->seq.store(0, std::memory_order_relaxed);
+    slot->step = -1;
+    slot->nWalkers = 0;
+    slot->reserved = 0;
+  }
+
+  // The magic is written last: a reader that sees it also sees a fully initialised layout
+  _header = new (_base) RingHeader;
+  _header->version = 1;
+  _header->nSlots = nSlots;
+  _header->nWalkers = nWalkers;
+  _header->slotBytes = slotBytes;
+  _header->dataOffset = dataOffset;
+  _header->published.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+}
+
+SnapshotRing::~SnapshotRing() {
+  if (_base != nullptr) {
+    munmap(_base, _bytes);
+    shm_unlink(_name.c_str());
+  }
+}
+
+void SnapshotRing::publish(int step, const Point *walkers, int nWalkers) {
+  if (nWalkers > _nWalkers) {
+    throw std::runtime_error("SnapshotRing::publish: frame has more walkers than the ring was created for.");
+  }
+
+  std::lock_guard<std::mutex> lock(_publishMutex);
+  uint64_t frame = _header->published.load(std::memory_order_relaxed);
+  char* slotBase = static_cast<char*>(_base) + _header->dataOffset + _header->slotBytes*(frame % _nSlots);
+  SlotHeader* slot = reinterpret_cast<SlotHeader*>(slotBase);
+  double* data = reinterpret_cast<double*>(slotBase + sizeof(SlotHeader));
+
+  // sequence lock: odd while writing
+  uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->step = step;
+  slot->nWalkers = nWalkers;
+  for (int w = 0; w < nWalkers; ++w) {
+    data[3*w]     = walkers[w].x;
+    data[3*w + 1] = walkers[w].y;
+    data[3*w + 2] = walkers[w].z;
+  }
+
+  slot->seq.store(seq + 2, std::memory_order_release);
+  _header->published.store(frame + 1, std::memory_order_release);
+}
@@ -0,0 +1,72 @@
+#ifndef SNAPSHOT_RING_H
+#define SNAPSHOT_RING_H
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <string>
+
+#include "utils.hpp"
+
+/**
+ * @brief Ring of the latest walker snapshots exposed through POSIX shared memory.
+ *
+ * The segment (/dev/shm/<name> on Linux) starts with a RingHeader followed by nSlots fixed-size slots.
+ * Each slot is a SlotHeader followed by nWalkers*3 doubles (x y z per walker, same order as the .dat files).
+ * Every slot is protected by a sequence lock: the writer makes `seq` odd while copying and even when done,
+ * so a reader that sees the same even `seq` before and after reading has a consistent frame.
+ * Readers can map the segment read-only (see LiveRing in data_analysis.py) and view frames without copies.
+ */
+class SnapshotRing {
+ public:
+  static constexpr char MAGIC[8] = {'R','W','R','I','N','G','0','1'};
+
+  struct RingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nSlots;
+    uint64_t nWalkers;
+    uint64_t slotBytes;               // size of one slot, header included
+    uint64_t dataOffset;              // offset of the first slot from the start of the segment
+    std::atomic<uint64_t> published;  // number of frames published so far, latest is slot (published-1) % nSlots
+  };
+
+  struct SlotHeader {
+    std::atomic<uint64_t> seq;        // odd while the writer is copying the frame
+    int64_t step;
+    uint64_t nWalkers;
+    uint64_t reserved;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory ring needs lock-free 64 bit atomics");
+
+  /**
+   * @brief Creates (or replaces) the shared memory segment `name` holding `nSlots` frames of `nWalkers` walkers.
+   *
+   * @param name Name of the segment, with or without the leading '/'.
+   * @param nSlots Number of snapshots kept in the ring.
+   * @param nWalkers Maximum number of walkers in a frame.
+   */
+  SnapshotRing(std::string name, int nSlots, int nWalkers);
+
+  SnapshotRing(const SnapshotRing &src) = delete;
+  SnapshotRing& operator=(const SnapshotRing &src) = delete;
+  ~SnapshotRing();                  // unmaps and unlinks the segment
+
+  // Copy the positions of the walkers into the next slot of the ring. Concurrent publishers are serialised
+  void publish(int step, const Point* walkers, int nWalkers);
+
+  const std::string& name() const { return _name; };
+  int nSlots() const { return _nSlots; };
+
+ private:
+  std::string _name;
+  int _nSlots;
+  int _nWalkers;
+  size_t _bytes = 0;
+  void* _base = nullptr;
+  RingHeader* _header = nullptr;
+  std::mutex _publishMutex;     // the sequence lock of the slots allows a single writer at a time
+};
+
+#endif  //SNAPSHOT_RING_H
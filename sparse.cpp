@@ -0,0 +1,127 @@
+#include "sparse.h"
+#include <cmath>
+#include <stdexcept>
+
+void SparseMatrix::multiply(const std::vector<double> &x, std::vector<double> &y) const {
+  y.resize(n);
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i) {
+    double sum = 0;
+    for (long k = rowStart[i]; k < rowStart[i+1]; ++k)
+      sum += value[k]*x[column[k]];
+    y[i] = sum;
+  }
+}
+
+IncompleteCholesky::IncompleteCholesky(const SparseMatrix &a, double shift) {
+  // lower triangle of A, diagonal last in each row
+  _lower.n = a.n;
+  _lower.rowStart.assign(1, 0);
+  for (int i = 0; i < a.n; ++i) {
+    double diagonal = shift;
+    for (long k = a.rowStart[i]; k < a.rowStart[i+1]; ++k) {
+      int j = a.column[k];
+      if (j < i) {
+        _lower.column.push_back(j);
+        _lower.value.push_back(a.value[k]);
+      } else if (j == i) {
+        diagonal += a.value[k];
+      }
+    }
+    _lower.column.push_back(i);
+    _lower.value.push_back(diagonal);
+    _lower.rowStart.push_back(_lower.column.size());
+  }
+
+  // L_ij = (A_ij - sum_k<j L_ik L_jk) / L_jj, restricted to the pattern of A
+  std::vector<long>& start = _lower.rowStart;
+  for (int i = 0; i < _lower.n; ++i) {
+    long diag = start[i+1] - 1;
+    for (long p = start[i]; p < diag; ++p) {
+      int j = _lower.column[p];
+      double sum = _lower.value[p];
+      // sparse dot product of rows i and j, columns < j
+      long q = start[j];
+      for (long r = start[i]; r < p; ++r) {
+        while (q < start[j+1] - 1 && _lower.column[q] < _lower.column[r])
+          ++q;
+        if (q < start[j+1] - 1 && _lower.column[q] == _lower.column[r])
+          sum -= _lower.value[r]*_lower.value[q];
+      }
+      _lower.value[p] = sum / _lower.value[start[j+1] - 1];
+    }
+    double sum = _lower.value[diag];
+    for (long p = start[i]; p < diag; ++p)
+      sum -= _lower.value[p]*_lower.value[p];
+    if (sum <= 0) {
+      throw std::runtime_error("IncompleteCholesky: matrix is not positive definite, increase the diagonal shift.");
+    }
+    _lower.value[diag] = std::sqrt(sum);
+  }
+}
+
+void IncompleteCholesky::solve(const std::vector<double> &b, std::vector<double> &x) const {
+  const std::vector<long>& start = _lower.rowStart;
+  x = b;
+  // forward: L y = b
+  for (int i = 0; i < _lower.n; ++i) {
+    long diag = start[i+1] - 1;
+    double sum = x[i];
+    for (long p = start[i]; p < diag; ++p)
+      sum -= _lower.value[p]*x[_lower.column[p]];
+    x[i] = sum / _lower.value[diag];
+  }
+  // backward: L^T x = y, scattering each solved value to the rows above
+  for (int i = _lower.n - 1; i >= 0; --i) {
+    long diag = start[i+1] - 1;
+    x[i] /= _lower.value[diag];
+    for (long p = start[i]; p < diag; ++p)
+      x[_lower.column[p]] -= _lower.value[p]*x[i];
+  }
+}
+
+int conjugateGradient(const SparseMatrix &a, const IncompleteCholesky &preconditioner, const std::vector<double> &b,
+                      std::vector<double> &x, double tolerance, int maxIterations) {
+  auto dot = [](const std::vector<double>& u, const std::vector<double>& v) {
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+    for (long i = 0; i < (long)u.size(); ++i)
+      sum += u[i]*v[i];
+    return sum;
+  };
+
+  x.resize(a.n, 0);
+  std::vector<double> r, z, p, q;
+  a.multiply(x, q);
+  r.resize(a.n);
+  for (int i = 0; i < a.n; ++i)
+    r[i] = b[i] - q[i];
+
+  double threshold = tolerance*std::sqrt(dot(b, b));
+  if (std::sqrt(dot(r, r)) <= threshold)
+    return 0;
+
+  preconditioner.solve(r, z);
+  p = z;
+  double rz = dot(r, z);
+  for (int iteration = 1; iteration <= maxIterations; ++iteration) {
+    a.multiply(p, q);
+    double alpha = rz / dot(p, q);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a.n; ++i) {
+      x[i] += alpha*p[i];
+      r[i] -= alpha*q[i];
+    }
+    if (std::sqrt(dot(r, r)) <= threshold)
+      return iteration;
+
+    preconditioner.solve(r, z);
+    double rzNew = dot(r, z);
+    double beta = rzNew / rz;
+    rz = rzNew;
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a.n; ++i)
+      p[i] = z[i] + beta*p[i];
+  }
+  return -maxIterations;
+}
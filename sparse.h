@@ -0,0 +1,44 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <vector>
+
+// Square sparse matrix in compressed sparse row form, columns sorted within each row
+struct SparseMatrix {
+  int n = 0;
+  std::vector<long> rowStart;   // n+1 entries
+  std::vector<int> column;
+  std::vector<double> value;
+
+  // y = A x
+  void multiply(const std::vector<double>& x, std::vector<double>& y) const;
+};
+
+/**
+ * @brief Zero fill-in incomplete Cholesky factor L (A ~ L L^T) of a symmetric positive (semi)definite matrix.
+ *
+ * The factor keeps the sparsity pattern of the lower triangle of A, so it costs as much memory as A itself.
+ * `shift` is added to the diagonal before factoring, to keep semidefinite matrices (pure Neumann Laplacians)
+ * factorisable; it only affects the preconditioner, not the system solved with it.
+ */
+class IncompleteCholesky {
+  SparseMatrix _lower;
+
+ public:
+  IncompleteCholesky(const SparseMatrix& a, double shift = 0);
+
+  // x = (L L^T)^-1 b
+  void solve(const std::vector<double>& b, std::vector<double>& x) const;
+};
+
+/**
+ * @brief Solves A x = b with the conjugate gradient method preconditioned by `preconditioner`.
+ *
+ * `x` is used as the initial guess. Iterates until |r| <= tolerance |b|.
+ *
+ * @return Number of iterations, negative if the tolerance was not reached within maxIterations.
+ */
+int conjugateGradient(const SparseMatrix& a, const IncompleteCholesky& preconditioner, const std::vector<double>& b,
+                      std::vector<double>& x, double tolerance = 1e-8, int maxIterations = 10000);
+
+#endif  //SPARSE_H
@@ -0,0 +1,33 @@
+#include "sparse_grid.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+int32_t SparseGrid::get(long i, long j, long k) const {
+  if (!inside(i, j, k))
+    return _background;
+  uint64_t u = i + COORDINATE_LIMIT, v = j + COORDINATE_LIMIT, w = k + COORDINATE_LIMIT;
+  auto node = _root.find(nodeKey(u, v, w));
+  if (node == _root.end())
+    return _background;
+  const Leaf* leaf = node->second->leaves[leafOffset(u, v, w)].get();
+  return leaf ? leaf->values[valueOffset(u, v, w)] : _background;
+}
+
+void SparseGrid::set(long i, long j, long k, int32_t value) {
+  if (!inside(i, j, k)) {
+    throw std::runtime_error("SparseGrid::set: (" + std::to_string(i) + ", " + std::to_string(j) + ", " +
+                             std::to_string(k) + ") is out of range.");
+  }
+  uint64_t u = i + COORDINATE_LIMIT, v = j + COORDINATE_LIMIT, w = k + COORDINATE_LIMIT;
+  std::unique_ptr<Node>& node = _root[nodeKey(u, v, w)];
+  if (!node)
+    node = std::make_unique<Node>();
+  std::unique_ptr<Leaf>& leaf = node->leaves[leafOffset(u, v, w)];
+  if (!leaf) {
+    leaf = std::make_unique<Leaf>();
+    std::fill(leaf->values, leaf->values + LEAF_SIZE, _background);
+    ++_nLeaves;
+  }
+  leaf->values[valueOffset(u, v, w)] = value;
+}
@@ -0,0 +1,75 @@
+#ifndef SPARSE_GRID_H
+#define SPARSE_GRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * @brief Sparse hierarchical grid of int values over integer lattice coordinates (VDB-style).
+ *
+ * Three levels: a root hash map of internal nodes, each internal node a dense 16^3 table of leaf pointers, each leaf
+ * a dense 8^3 brick of values. Only the bricks containing a value are allocated, so a narrow band costs memory in
+ * proportion to its area, and a lookup is one small hash lookup (a band has few internal nodes) and two array
+ * indexings; neighbouring lattice points mostly share a brick, hence a cache line.
+ *
+ * Coordinates must lie in [-2^20, 2^20) on each axis; lookups outside return the background value.
+ */
+class SparseGrid {
+ public:
+  static constexpr int LEAF_LOG2 = 3;                       // 8^3 values per leaf
+  static constexpr int NODE_LOG2 = 4;                       // 16^3 leaves per internal node
+  static constexpr long COORDINATE_LIMIT = 1L << 20;
+
+ private:
+  static constexpr int LEAF_SIZE = 1 << 3*LEAF_LOG2;
+  static constexpr int NODE_SIZE = 1 << 3*NODE_LOG2;
+
+  struct Leaf {
+    int32_t values[LEAF_SIZE];
+  };
+  struct Node {
+    std::unique_ptr<Leaf> leaves[NODE_SIZE];
+  };
+
+  int32_t _background;
+  std::unordered_map<uint64_t, std::unique_ptr<Node>> _root;
+  size_t _nLeaves = 0;
+
+  static bool inside(long i, long j, long k) {
+    return i >= -COORDINATE_LIMIT && i < COORDINATE_LIMIT && j >= -COORDINATE_LIMIT && j < COORDINATE_LIMIT &&
+           k >= -COORDINATE_LIMIT && k < COORDINATE_LIMIT;
+  };
+  // Key of the internal node containing (i,j,k), from the coordinates shifted to [0, 2^21)
+  static uint64_t nodeKey(uint64_t u, uint64_t v, uint64_t w) {
+    constexpr int SHIFT = LEAF_LOG2 + NODE_LOG2;
+    return ((u >> SHIFT) << 42) | ((v >> SHIFT) << 21) | (w >> SHIFT);
+  };
+  static int leafOffset(uint64_t u, uint64_t v, uint64_t w) {
+    constexpr uint64_t MASK = (1 << NODE_LOG2) - 1;
+    return int((((u >> LEAF_LOG2) & MASK) << 2*NODE_LOG2) | (((v >> LEAF_LOG2) & MASK) << NODE_LOG2) |
+               ((w >> LEAF_LOG2) & MASK));
+  };
+  static int valueOffset(uint64_t u, uint64_t v, uint64_t w) {
+    constexpr uint64_t MASK = (1 << LEAF_LOG2) - 1;
+    return int(((u & MASK) << 2*LEAF_LOG2) | ((v & MASK) << LEAF_LOG2) | (w & MASK));
+  };
+
+ public:
+  SparseGrid(int32_t background = -1) : _background{background} {};
+
+  // Value at (i,j,k), the background value where none was set
+  int32_t get(long i, long j, long k) const;
+
+  // Sets the value at (i,j,k), allocating its leaf if needed; throws if the coordinates are out of range
+  void set(long i, long j, long k, int32_t value);
+
+  int32_t background() const { return _background; };
+  size_t nLeaves() const { return _nLeaves; };
+  size_t nNodes() const { return _root.size(); };
+  // Bytes allocated for the nodes and leaves (the root hash map excepted)
+  size_t memoryBytes() const { return _root.size()*sizeof(Node) + _nLeaves*sizeof(Leaf); };
+};
+
+#endif  //SPARSE_GRID_H
@@ -0,0 +1,72 @@
+#include "spatial_sort.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "morton.h"
+
+void radixSort(const std::vector<uint64_t> &keys, std::vector<uint32_t> &order) {
+  const size_t n = order.size();
+  std::vector<uint32_t> buffer(n);
+  std::vector<uint64_t> sorted(n), sortedBuffer(n);
+  for (size_t i = 0; i < n; ++i)
+    sorted[i] = keys[order[i]];
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t count[256] = {};
+    for (size_t i = 0; i < n; ++i)
+      ++count[(sorted[i] >> shift) & 0xff];
+    // all the keys share this digit: the pass would not move anything
+    if (n == 0 || count[(sorted[0] >> shift) & 0xff] == n)
+      continue;
+
+    size_t offset = 0;
+    for (size_t &c : count) {
+      size_t first = offset;
+      offset += c;
+      c = first;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      size_t to = count[(sorted[i] >> shift) & 0xff]++;
+      sortedBuffer[to] = sorted[i];
+      buffer[to] = order[i];
+    }
+    sorted.swap(sortedBuffer);
+    order.swap(buffer);
+  }
+}
+
+void sortByCell(PointArrays &points, std::vector<int> &ids, double cell) {
+  const size_t n = points.size();
+  if (n != ids.size()) {
+    throw std::runtime_error("sortByCell: " + std::to_string(ids.size()) + " ids for " + std::to_string(n) + " points.");
+  }
+  if (n < 2)
+    return;
+
+  const double *x = points.x(), *y = points.y(), *z = points.z();
+  double lowest[3] = {*std::min_element(x, x + n), *std::min_element(y, y + n), *std::min_element(z, z + n)};
+  const double limit = double((1 << 21) - 1);
+  auto coordinate = [&](double v, int d) {
+    double c = std::floor((v - lowest[d])/cell);
+    return uint64_t(c < limit ? c : limit);   // also maps NaN (walker off the surface) to the last cell
+  };
+
+  std::vector<uint64_t> keys(n);
+  std::vector<uint32_t> order(n);
+  for (size_t s = 0; s < n; ++s) {
+    keys[s] = mortonCode(coordinate(x[s], 0), coordinate(y[s], 1), coordinate(z[s], 2));
+    order[s] = s;
+  }
+  radixSort(keys, order);
+
+  PointArrays sorted(n);
+  std::vector<int> sortedIds(n);
+  for (size_t s = 0; s < n; ++s) {
+    sorted[s] = points[order[s]];
+    sortedIds[s] = ids[order[s]];
+  }
+  points = std::move(sorted);
+  ids = std::move(sortedIds);
+}
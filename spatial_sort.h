@@ -0,0 +1,22 @@
+#ifndef SPATIAL_SORT_H
+#define SPATIAL_SORT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "point_arrays.h"
+
+/**
+ * @brief Sorts the points by the Z-order (Morton) code of their cell, cubes of side `cell` from the lowest point.
+ *
+ * Points of the same cell end up contiguous and neighbouring cells mostly close, so per-point lookups into spatial
+ * tables (band index, grids) stream through memory. `ids` (ids[s]: identity of the point in slot s) is permuted
+ * with the points, so that outputs can still be written in identity order. Cell coordinates beyond 2^21 are
+ * clamped. LSD radix sort on 8-bit digits, skipping the digits shared by all the keys: O(n), stable.
+ */
+void sortByCell(PointArrays& points, std::vector<int>& ids, double cell);
+
+// Stable LSD radix sort of `order` (indices into keys) by keys[order[i]]
+void radixSort(const std::vector<uint64_t>& keys, std::vector<uint32_t>& order);
+
+#endif  //SPATIAL_SORT_H
@@ -0,0 +1,272 @@
+#include "statistics.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+double geodesicAngle(Point a, Point b, Point centre) {
+  double ax = a.x - centre.x, ay = a.y - centre.y, az = a.z - centre.z;
+  double bx = b.x - centre.x, by = b.y - centre.y, bz = b.z - centre.z;
+  double na = std::sqrt(ax*ax + ay*ay + az*az);
+  double nb = std::sqrt(bx*bx + by*by + bz*bz);
+  ax /= na; ay /= na; az /= na;
+  bx /= nb; by /= nb; bz /= nb;
+
+  double dot = std::min(1.0, std::max(-1.0, ax*bx + ay*by + az*bz));
+  double cx = ay*bz - az*by;
+  double cy = az*bx - ax*bz;
+  double cz = ax*by - ay*bx;
+  return std::atan2(std::sqrt(cx*cx + cy*cy + cz*cz), dot);
+}
+
+double geodesicVariance(const Point *walkers, size_t n, Point start, Point centre) {
+  if (n == 0)
+    return 0;
+
+  double sum = 0;
+  #pragma omp parallel for reduction(+:sum) schedule(static)
+  for (long w = 0; w < (long)n; ++w) {
+    double angle = geodesicAngle(walkers[w], start, centre);
+    sum += angle*angle;
+  }
+  return sum / n;
+}
+
+
+void Moments::add(double x) {
+  double n1 = _n;
+  _n += 1;
+  double delta = x - _mean;
+  double deltaN = delta / _n;
+  double deltaN2 = deltaN*deltaN;
+  double term1 = delta*deltaN*n1;
+
+  _mean += deltaN;
+  _m4 += term1*deltaN2*(_n*_n - 3*_n + 3) + 6*deltaN2*_m2 - 4*deltaN*_m3;
+  _m3 += term1*deltaN*(_n - 2) - 3*deltaN*_m2;
+  _m2 += term1;
+}
+
+void Moments::merge(const Moments &other) {
+  if (other._n == 0)
+    return;
+  if (_n == 0) {
+    *this = other;
+    return;
+  }
+
+  double na = _n;
+  double nb = other._n;
+  double n = na + nb;
+  double delta = other._mean - _mean;
+  double delta2 = delta*delta;
+
+  double m2 = _m2 + other._m2 + delta2*na*nb/n;
+  double m3 = _m3 + other._m3 + delta2*delta*na*nb*(na - nb)/(n*n)
+              + 3*delta*(na*other._m2 - nb*_m2)/n;
+  double m4 = _m4 + other._m4 + delta2*delta2*na*nb*(na*na - na*nb + nb*nb)/(n*n*n)
+              + 6*delta2*(na*na*other._m2 + nb*nb*_m2)/(n*n) + 4*delta*(na*other._m3 - nb*_m3)/n;
+
+  _mean += delta*nb/n;
+  _m2 = m2;
+  _m3 = m3;
+  _m4 = m4;
+  _n = n;
+}
+
+double Moments::variance() const {
+  return _n > 1 ? _m2/(_n - 1) : 0;
+}
+
+double Moments::stddev() const {
+  return std::sqrt(variance());
+}
+
+double Moments::standardError() const {
+  return _n > 0 ? std::sqrt(variance()/_n) : 0;
+}
+
+double Moments::skewness() const {
+  return _m2 > 0 ? std::sqrt(_n)*_m3/std::pow(_m2, 1.5) : 0;
+}
+
+double Moments::kurtosis() const {
+  return _m2 > 0 ? _n*_m4/(_m2*_m2) - 3 : 0;
+}
+
+void Moments::state(double *out) const {
+  out[0] = _n;
+  out[1] = _mean;
+  out[2] = _m2;
+  out[3] = _m3;
+  out[4] = _m4;
+}
+
+Moments Moments::fromState(const double *state) {
+  Moments m;
+  m._n = state[0];
+  m._mean = state[1];
+  m._m2 = state[2];
+  m._m3 = state[3];
+  m._m4 = state[4];
+  return m;
+}
+
+
+const std::vector<std::string>& EnsembleMoments::names() {
+  static const std::vector<std::string> names = {"x", "y", "z", "displacement", "squared_displacement", "angle", "squared_angle"};
+  return names;
+}
+
+std::vector<const Moments*> EnsembleMoments::all() const {
+  return {&x, &y, &z, &displacement, &squaredDisplacement, &angle, &squaredAngle};
+}
+
+void EnsembleMoments::add(Point p, Point start, Point centre) {
+  x.add(p.x);
+  y.add(p.y);
+  z.add(p.z);
+  double dx = p.x - start.x, dy = p.y - start.y, dz = p.z - start.z;
+  double d2 = dx*dx + dy*dy + dz*dz;
+  displacement.add(std::sqrt(d2));
+  squaredDisplacement.add(d2);
+  double theta = geodesicAngle(p, start, centre);
+  angle.add(theta);
+  squaredAngle.add(theta*theta);
+}
+
+void EnsembleMoments::merge(const EnsembleMoments &other) {
+  x.merge(other.x);
+  y.merge(other.y);
+  z.merge(other.z);
+  displacement.merge(other.displacement);
+  squaredDisplacement.merge(other.squaredDisplacement);
+  angle.merge(other.angle);
+  squaredAngle.merge(other.squaredAngle);
+}
+
+EnsembleMoments ensembleMoments(const Point *walkers, size_t n, Point start, Point centre) {
+  int nThreads = 1;
+#ifdef _OPENMP
+  nThreads = omp_get_max_threads();
+#endif
+  std::vector<EnsembleMoments> partial(nThreads);
+
+  #pragma omp parallel num_threads(nThreads)
+  {
+    int t = 0;
+#ifdef _OPENMP
+    t = omp_get_thread_num();
+#endif
+    #pragma omp for schedule(static)
+    for (long w = 0; w < (long)n; ++w) {
+      partial[t].add(walkers[w], start, centre);
+    }
+  }
+
+  EnsembleMoments result;
+  for (auto const& p : partial) {
+    result.merge(p);
+  }
+  return result;
+}
+
+
+void openStepLog(std::fstream &file, const std::string &filename, const std::string &header,
+                 uint64_t recordBytes, int64_t resumeStep) {
+  // keep the records of the steps before resumeStep, if the file was written with the same header
+  uint64_t end = 0;
+  if (resumeStep > 0 && std::filesystem::exists(filename)) {
+    uint64_t size = std::filesystem::file_size(filename);
+    std::ifstream in(filename, std::ios::binary);
+    std::string existing(header.size(), '\0');
+    in.read(existing.data(), existing.size());
+    if (in && existing == header) {
+      end = header.size();
+      int64_t step;
+      while (end + recordBytes <= size && in.seekg(end) && in.read(reinterpret_cast<char*>(&step), sizeof(step))
+             && step < resumeStep) {
+        end += recordBytes;
+      }
+    }
+  }
+
+  if (end > 0) {
+    std::filesystem::resize_file(filename, end);
+    file.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(end);
+  } else {
+    file.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    file.write(header.data(), header.size());
+  }
+  if (!file) {
+    throw std::runtime_error("openStepLog: cannot open " + filename + ".");
+  }
+}
+
+
+static constexpr char MOMENTS_MAGIC[8] = {'R','W','M','O','M','0','0','1'};
+
+MomentsLog::MomentsLog(const std::string &filename, int64_t resumeStep) {
+  uint64_t nQuantities = EnsembleMoments::names().size();
+  std::string header(MOMENTS_MAGIC, sizeof(MOMENTS_MAGIC));
+  header.append(reinterpret_cast<const char*>(&nQuantities), sizeof(nQuantities));
+  uint64_t recordBytes = sizeof(int64_t) + nQuantities*Moments::STATE_SIZE*sizeof(double);
+
+  openStepLog(_file, filename, header, recordBytes, resumeStep);
+}
+
+void MomentsLog::write(int64_t step, const EnsembleMoments &moments) {
+  std::vector<double> record;
+  for (const Moments* m : moments.all()) {
+    double state[Moments::STATE_SIZE];
+    m->state(state);
+    record.insert(record.end(), state, state + Moments::STATE_SIZE);
+  }
+  _file.write(reinterpret_cast<const char*>(&step), sizeof(step));
+  _file.write(reinterpret_cast<const char*>(record.data()), record.size()*sizeof(double));
+}
+
+
+StepTable::StepTable(const std::string &filename, const std::vector<std::string> &columns, int64_t resumeStep) {
+  // rows of the previous part of the run
+  std::vector<std::string> kept;
+  if (resumeStep > 0 && std::filesystem::exists(filename)) {
+    std::ifstream in(filename);
+    std::string line;
+    std::getline(in, line);   // header
+    while (std::getline(in, line)) {
+      int64_t step = 0;
+      auto res = std::from_chars(line.data(), line.data() + line.size(), step);
+      if (res.ec == std::errc() && step < resumeStep)
+        kept.push_back(line);
+    }
+  }
+
+  _out.open(filename, std::ios::trunc);
+  if (!_out) {
+    throw std::runtime_error("StepTable: cannot open " + filename + ".");
+  }
+  _out << "step";
+  for (auto const& column : columns) {
+    _out << ',' << column;
+  }
+  _out << '\n';
+  for (auto const& line : kept) {
+    _out << line << '\n';
+  }
+  _out.precision(17);
+}
+
+void StepTable::write(int64_t step, const std::vector<double> &values) {
+  _out << step;
+  for (double value : values) {
+    _out << ',' << value;
+  }
+  _out << '\n';
+}
@@ -0,0 +1,126 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * @brief Geodesic angle (in radians, in [0, pi]) between `a` and `b` seen from `centre`.
+ *
+ * Same formula as geodesic_distances() in data_analysis.py: atan2(|a x b|, a . b) on the unit vectors.
+ */
+double geodesicAngle(Point a, Point b, Point centre);
+
+/**
+ * @brief Mean squared geodesic angle between the walkers and `start`, as seen from `centre`.
+ *
+ * This is variance() of data_analysis.py, computed with a parallel (OpenMP) reduction over the walkers.
+ */
+double geodesicVariance(const Point* walkers, size_t n, Point start, Point centre);
+
+/**
+ * @brief Streaming mean and central moments up to the fourth order of a sample.
+ *
+ * Values are added one at a time with Welford's update, extended to the third and fourth moments (Pebay, 2008).
+ * Accumulators of disjoint samples (other threads, other processes) are combined exactly with merge() (Chan et al.),
+ * so statistics of 10^7 walkers never require storing their positions.
+ */
+class Moments {
+  double _n = 0;      // kept as a double: it only enters the formulas in floating point
+  double _mean = 0;
+  double _m2 = 0;     // sums of the powers of the deviations from the mean
+  double _m3 = 0;
+  double _m4 = 0;
+
+ public:
+  void add(double x);
+  void merge(const Moments& other);
+
+  uint64_t count() const { return _n; };
+  double mean() const { return _mean; };
+  double variance() const;              // sample variance (n-1 denominator)
+  double stddev() const;
+  double standardError() const;         // of the mean
+  double skewness() const;
+  double kurtosis() const;              // excess kurtosis (0 for a gaussian)
+
+  // Half width of the confidence interval of the mean, normal approximation (z = 1.96 for 95%)
+  double confidence(double z = 1.96) const { return z*standardError(); };
+
+  // Raw state {n, mean, M2, M3, M4}, to store accumulators and merge them in another process
+  static constexpr int STATE_SIZE = 5;
+  void state(double* out) const;
+  static Moments fromState(const double* state);
+};
+
+// Moments of the walker ensemble at one step
+struct EnsembleMoments {
+  Moments x, y, z;
+  Moments displacement;         // euclidean distance from the starting point
+  Moments squaredDisplacement;  // its mean is the MSD
+  Moments angle;                // geodesic angle from the starting point, seen from the centre
+  Moments squaredAngle;         // its mean is the geodesic variance
+
+  static const std::vector<std::string>& names();
+  std::vector<const Moments*> all() const;
+
+  void add(Point p, Point start, Point centre);
+  void merge(const EnsembleMoments& other);
+};
+
+/**
+ * @brief Accumulates the moments of all the walkers with OpenMP.
+ *
+ * Each thread accumulates a contiguous block of walkers and the partial results are merged in thread order,
+ * so the result is reproducible for a given number of threads.
+ */
+EnsembleMoments ensembleMoments(const Point* walkers, size_t n, Point start, Point centre);
+
+/**
+ * @brief Opens a binary per-step log: a fixed header followed by fixed-size records, each starting with an int64 step.
+ *
+ * A new file is created with `header`, unless resumeStep > 0 and `filename` already starts with the same header:
+ * then the records of the steps before resumeStep are kept, the others are truncated away, and `file` is positioned
+ * to append after them.
+ */
+void openStepLog(std::fstream& file, const std::string& filename, const std::string& header,
+                 uint64_t recordBytes, int64_t resumeStep);
+
+/**
+ * @brief Binary log of the raw accumulator states at each logged step (<run>_moments.bin).
+ *
+ * Layout: 8 byte magic "RWMOM001", uint64 number of quantities, then one record per step: int64 step followed by
+ * Moments::STATE_SIZE doubles per quantity, in the order of EnsembleMoments::names(). Logs of independent runs can be
+ * merged step by step (see merge_moments in data_analysis.py). Resuming drops the records from `resumeStep` on.
+ */
+class MomentsLog {
+  std::fstream _file;
+
+ public:
+  MomentsLog(const std::string& filename, int64_t resumeStep = 0);
+
+  void write(int64_t step, const EnsembleMoments& moments);
+  void flush() { _file.flush(); };
+};
+
+/**
+ * @brief Per-step table of statistics, written as CSV (one row per logged step).
+ *
+ * When a run is resumed from `resumeStep`, the rows already in the file for earlier steps are kept and the others
+ * are dropped, so the table never contains the same step twice.
+ */
+class StepTable {
+  std::ofstream _out;
+
+ public:
+  StepTable(const std::string& filename, const std::vector<std::string>& columns, int64_t resumeStep = 0);
+
+  void write(int64_t step, const std::vector<double>& values);
+  void flush() { _out.flush(); };
+};
+
+#endif  //STATISTICS_H
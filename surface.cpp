@@ -1,9 +1,18 @@
 #include "surface.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <limits>
+#include <string>
 #include <iostream>
 #include <iomanip>
 #include <functional>
 #include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "morton.h"
+#include "occupancy.h"
 
 Surface::Surface(int nPoints, Point data) :
                 _nPoints{nPoints},
@@ -17,60 +26,223 @@ Surface::Surface(int nPoints, Point *data) :
   std::copy(data, data + nPoints, _data);
 }
 
-Surface::Surface(std::function<double(double, double, double)> phi, Interval x, Interval y, Interval z, double h) :
+// Number of lattice coordinates min + n*h (n >= 0) below max
+static int64_t latticeSize(Interval range, double h) {
+  int64_t n = std::max<int64_t>(0, std::ceil((range.max - range.min)/h));
+  while (n > 0 && range.min + (n - 1)*h >= range.max)
+    --n;
+  while (range.min + n*h < range.max)
+    ++n;
+  return n;
+}
+
+// Lattice blocks sampled when refining a band (see Surface::refine): blocks of factor^3 lattice points
+struct Surface::RefinementBlocks {
+  int64_t factor;
+  Occupancy occupied;                      // blocks to sample, over block coordinates
+  int64_t nBlocksY;
+  std::vector<std::array<int64_t,2>> rows; // first and last occupied block along z of each (x, y) block row
+};
+
+Surface::Surface(std::function<double(double, double, double)> phi, Interval x, Interval y, Interval z, double h,
+                 bool packed) :
                 _nPoints{0},
                 _data{nullptr},
                 _phi{phi},
-                _h{h} {
-
-  int domainPoints = (x.max - x.min)*(y.max - y.min)*(z.max - z.min)/(h*h*h);
-  Point* temp = new Point[domainPoints];
+                _h{h},
+                _origin{x.min, y.min, z.min} {
+  sample(x, y, z, packed, nullptr);
+}
 
+void Surface::sample(Interval x, Interval y, Interval z, bool packed, const RefinementBlocks* blocks) {
+  release();
+  const double h = _h;
+  int64_t nx = latticeSize(x, h), ny = latticeSize(y, h), nz = latticeSize(z, h);
+  if (packed && std::max({nx, ny, nz}) > (int64_t(1) << LATTICE_BITS)) {
+    throw std::runtime_error("Surface: the lattice is too large to be packed.");
+  }
   double delta = 1.1 * sqrt(3) * h;
 
-  for (double i = x.min; i < x.max; i += h) {
-    for (double j = y.min; j < y.max; j += h) {
-      for (double k = z.min; k < z.max; k += h) {
-        double dist = phi(i,j,k);
+  // only the band is kept: memory scales with the surface area, not with the volume of the domain
+  std::vector<Point> band;
+  for (int64_t a = 0; a < nx; ++a) {
+    double i = x.min + a*h;
+    for (int64_t b = 0; b < ny; ++b) {
+      double j = y.min + b*h;
+      int64_t first = 0, last = nz;
+      if (blocks) {
+        const int64_t f = blocks->factor;
+        auto row = blocks->rows[(a/f)*blocks->nBlocksY + b/f];
+        first = row[0]*f;
+        last = std::min(nz, (row[1] + 1)*f);
+      }
+      for (int64_t c = first; c < last; ++c) {
+        if (blocks && !blocks->occupied.contains(a/blocks->factor, b/blocks->factor, c/blocks->factor)) {
+          c = (c/blocks->factor + 1)*blocks->factor - 1;   // skip the rest of the block
+          continue;
+        }
+        double k = z.min + c*h;
+        double dist = _phi(i,j,k);
         if (dist > -delta && dist < delta) {
-          temp[_nPoints] = {i,j,k};
-          ++_nPoints;
+          if (packed)
+            _lattice.push_back((uint64_t(a) << 2*LATTICE_BITS) | (uint64_t(b) << LATTICE_BITS) | uint64_t(c));
+          else
+            band.push_back({i,j,k});
         }
       }
     }
   }
 
-  _data = new Point[_nPoints];
-  std::copy(temp, temp + _nPoints, _data);
-  delete[] temp;
+  size_t size = packed ? _lattice.size() : band.size();
+  if (size > size_t(std::numeric_limits<int>::max())) {
+    throw std::runtime_error("Surface: the band has " + std::to_string(size) + " points, more than an int can index.");
+  }
+  _nPoints = size;
+  if (packed) {
+    _lattice.shrink_to_fit();
+  } else {
+    _data = new Point[_nPoints];
+    std::copy(band.begin(), band.end(), _data);
+  }
+}
+
+Surface Surface::refine(const Surface &coarse, Interval x, Interval y, Interval z, double h, bool packed, int margin) {
+  if (coarse._phi == nullptr || coarse._h == 0) {
+    throw std::runtime_error("Surface::refine: the coarse surface needs to be constructed using a function.");
+  }
+  const int64_t factor = std::llround(coarse._h/h);
+  if (factor < 1 || std::abs(factor*h - coarse._h) > 1e-9*coarse._h) {
+    throw std::runtime_error("Surface::refine: h = " + std::to_string(h) + " does not divide the coarse h = " +
+                             std::to_string(coarse._h) + ".");
+  }
+
+  // blocks of the fine lattice: fine point a lies in block a/factor, whose corner is coarse lattice point a/factor
+  const int64_t nBlocks[3] = {(latticeSize(x, h) + factor - 1)/factor, (latticeSize(y, h) + factor - 1)/factor,
+                              (latticeSize(z, h) + factor - 1)/factor};
+  RefinementBlocks blocks{factor, Occupancy({0, 0, 0}, {long(nBlocks[0]) - 1, long(nBlocks[1]) - 1, long(nBlocks[2]) - 1}),
+                          nBlocks[1], {}};
+  blocks.rows.assign(nBlocks[0]*nBlocks[1], {nBlocks[2], -1});
+  const double mins[3] = {x.min, y.min, z.min};
+  for (int n = 0; n < coarse._nPoints; ++n) {
+    Point p = coarse[n];
+    const double coordinates[3] = {p.x, p.y, p.z};
+    int64_t lo[3], hi[3];
+    for (int d = 0; d < 3; ++d) {
+      int64_t index = std::llround((coordinates[d] - mins[d])/coarse._h);
+      if (std::abs(mins[d] + index*coarse._h - coordinates[d]) > 1e-6*coarse._h) {
+        throw std::runtime_error("Surface::refine: the coarse band is not on the lattice of the domain.");
+      }
+      lo[d] = std::max<int64_t>(0, index - margin);
+      hi[d] = std::min<int64_t>(nBlocks[d] - 1, index + margin);
+    }
+    for (int64_t i = lo[0]; i <= hi[0]; ++i) {
+      for (int64_t j = lo[1]; j <= hi[1]; ++j) {
+        auto& row = blocks.rows[i*nBlocks[1] + j];
+        row = {std::min(row[0], lo[2]), std::max(row[1], hi[2])};
+        for (int64_t k = lo[2]; k <= hi[2]; ++k)
+          blocks.occupied.set(i, j, k);
+      }
+    }
+  }
+
+  Surface fine;
+  fine._phi = coarse._phi;
+  fine._h = h;
+  fine._origin = {x.min, y.min, z.min};
+  fine.sample(x, y, z, packed, &blocks);
+  return fine;
+}
+
+Surface::Surface(int nPoints, const Point *data, std::function<double(double, double, double)> phi, double h) :
+                _nPoints{nPoints},
+                _data{new Point[nPoints]},
+                _phi{phi},
+                _h{h} {
+  std::copy(data, data + nPoints, _data);
+}
+
+Surface::Surface(std::shared_ptr<const MappedFile> file, size_t offset, int nPoints,
+                 std::function<double(double, double, double)> phi, double h, std::vector<int> permutation) :
+                _nPoints{nPoints},
+                _phi{phi},
+                _h{h},
+                _file{file},
+                _permutation{std::move(permutation)} {
+  if (offset % alignof(Point) != 0 || offset + nPoints*sizeof(Point) > file->size()) {
+    throw std::runtime_error("Surface: points out of the bounds of " + file->filename() + ".");
+  }
+  if (!_permutation.empty() && _permutation.size() != size_t(nPoints)) {
+    throw std::runtime_error("Surface: the permutation of " + file->filename() + " does not match its points.");
+  }
+  // never written through: a Surface is read-only once constructed
+  _data = const_cast<Point*>(reinterpret_cast<const Point*>(file->data() + offset));
 }
 
 Surface::Surface(const Surface &src) : 
                 _nPoints{src._nPoints},
-                _data{new Point[src._nPoints]} {
+                _data{nullptr},
+                _phi{src._phi},
+                _h{src._h},
+                _file{src._file},
+                _lattice{src._lattice},
+                _origin{src._origin},
+                _permutation{src._permutation} {
+  if (_file) {
+    _data = src._data;
+  } else if (src._data) {
+    _data = new Point[src._nPoints];
     std::copy(src._data, src._data + src._nPoints, _data);
+  }
 }
 
 Surface::Surface(Surface &&src) : 
               _nPoints{src._nPoints},
-              _data{src._data} {
+              _data{src._data},
+              _phi{std::move(src._phi)},
+              _h{src._h},
+              _file{std::move(src._file)},
+              _lattice{std::move(src._lattice)},
+              _origin{src._origin},
+              _permutation{std::move(src._permutation)} {
   src._nPoints = 0;
   src._data = nullptr;
 }
 
+void Surface::release() {
+  if (!_file)
+    delete[] _data;
+  _file.reset();
+  _lattice.clear();
+  _data = nullptr;
+  _nPoints = 0;
+}
+
 Surface &Surface::operator=(const Surface &src) {
   // Guard self assignment
   if (this == &src)
     return *this;
 
-  if (_nPoints != src._nPoints) {           // resource in *this cannot be reused
-    Point* temp = new Point[src._nPoints];  // allocate resource, if throws, do nothing
-    delete[] _data;                         // release resource in *this
-    _data = temp;
+  if (src._file || !src._data) {            // share the read-only mapping, or copy the packed storage
+    std::shared_ptr<const MappedFile> file = src._file;
+    release();
+    _file = file;
+    _data = src._data;
     _nPoints = src._nPoints;
-  } 
+    _lattice = src._lattice;
+  } else {
+    if (_file || !_data || _nPoints != src._nPoints) {  // resource in *this cannot be reused
+      Point* temp = new Point[src._nPoints];            // allocate resource, if throws, do nothing
+      release();                                        // release resource in *this
+      _data = temp;
+      _nPoints = src._nPoints;
+    }
+    std::copy(src._data, src._data + src._nPoints, _data);
+  }
 
-  std::copy(src._data, src._data + src._nPoints, _data);
+  _phi = src._phi;
+  _h = src._h;
+  _origin = src._origin;
+  _permutation = src._permutation;
   return *this;
 }
 
@@ -79,9 +251,15 @@ Surface &Surface::operator=(Surface &&src) {
   if (this == &src)
     return *this;
 
-  delete[] _data;       // release resource in *this
+  release();            // release resource in *this
   _data = src._data;
   _nPoints = src._nPoints;
+  _phi = std::move(src._phi);
+  _h = src._h;
+  _file = std::move(src._file);
+  _lattice = std::move(src._lattice);
+  _origin = src._origin;
+  _permutation = std::move(src._permutation);
   src._data = nullptr;  // leave src in valid state
   src._nPoints = 0;
 
@@ -89,7 +267,7 @@ Surface &Surface::operator=(Surface &&src) {
 }
 
 Surface::~Surface() {
-  delete[] _data;
+  release();
 }
 
 Point Surface::project(Point p) const {
@@ -122,6 +300,102 @@ Point Surface::project(Point p) const {
   return p;
 }
 
+Point Surface::normal(Point p) const {
+  if (_phi == nullptr || _h == 0) {
+    throw std::runtime_error("Surface::normal: phi function or h not defined. "
+      "The surface needs to be constructed using a function to use normal method.");
+  }
+
+  double gx = _phi(p.x+_h, p.y, p.z) - _phi(p.x-_h, p.y, p.z);
+  double gy = _phi(p.x, p.y+_h, p.z) - _phi(p.x, p.y-_h, p.z);
+  double gz = _phi(p.x, p.y, p.z+_h) - _phi(p.x, p.y, p.z-_h);
+  double norm = std::sqrt(gx*gx + gy*gy + gz*gz);
+  if (norm == 0)
+    return {0, 0, 0};
+  return {gx/norm, gy/norm, gz/norm};
+}
+
+bool Surface::pack(Point origin) {
+  if (packed())
+    return true;
+  if (_h == 0)
+    return false;
+
+  const int64_t limit = int64_t(1) << LATTICE_BITS;
+  std::vector<uint64_t> lattice(_nPoints);
+  for (int n = 0; n < _nPoints; ++n) {
+    Point p = _data[n];
+    int64_t a = std::llround((p.x - origin.x)/_h);
+    int64_t b = std::llround((p.y - origin.y)/_h);
+    int64_t c = std::llround((p.z - origin.z)/_h);
+    if (a < 0 || b < 0 || c < 0 || a >= limit || b >= limit || c >= limit ||
+        origin.x + a*_h != p.x || origin.y + b*_h != p.y || origin.z + c*_h != p.z)
+      return false;
+    lattice[n] = (uint64_t(a) << 2*LATTICE_BITS) | (uint64_t(b) << LATTICE_BITS) | uint64_t(c);
+  }
+
+  int nPoints = _nPoints;
+  release();
+  _nPoints = nPoints;
+  _lattice = std::move(lattice);
+  _origin = origin;
+  return true;
+}
+
+void Surface::reorderMorton() {
+  if (_nPoints == 0 || _h == 0)
+    return;
+
+  // lattice coordinates relative to the lowest corner of the band
+  std::vector<std::array<int64_t,3>> cells(_nPoints);
+  std::array<int64_t,3> lowest = {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::max(),
+                                  std::numeric_limits<int64_t>::max()};
+  for (int n = 0; n < _nPoints; ++n) {
+    Point p = (*this)[n];
+    cells[n] = {std::llround(p.x/_h), std::llround(p.y/_h), std::llround(p.z/_h)};
+    for (int d = 0; d < 3; ++d)
+      lowest[d] = std::min(lowest[d], cells[n][d]);
+  }
+  const int64_t limit = int64_t(1) << LATTICE_BITS;
+  std::vector<std::pair<uint64_t,int>> order(_nPoints);
+  for (int n = 0; n < _nPoints; ++n) {
+    int64_t a = cells[n][0] - lowest[0], b = cells[n][1] - lowest[1], c = cells[n][2] - lowest[2];
+    bool fits = a < limit && b < limit && c < limit;
+    order[n] = {fits ? mortonCode(a, b, c) : std::numeric_limits<uint64_t>::max(), n};
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const std::pair<uint64_t,int>& l, const std::pair<uint64_t,int>& r) { return l.first < r.first; });
+
+  std::vector<int> permutation(_nPoints);
+  for (int n = 0; n < _nPoints; ++n)
+    permutation[n] = _permutation.empty() ? order[n].second : _permutation[order[n].second];
+
+  int nPoints = _nPoints;
+  if (packed()) {
+    std::vector<uint64_t> lattice(nPoints);
+    for (int n = 0; n < nPoints; ++n)
+      lattice[n] = _lattice[order[n].second];
+    _lattice = std::move(lattice);
+  } else {
+    Point* data = new Point[nPoints];
+    for (int n = 0; n < nPoints; ++n)
+      data[n] = _data[order[n].second];
+    release();
+    _data = data;
+    _nPoints = nPoints;
+  }
+  _permutation = std::move(permutation);
+}
+
+std::vector<int> Surface::permutation() const {
+  if (!_permutation.empty())
+    return _permutation;
+  std::vector<int> identity(_nPoints);
+  for (int n = 0; n < _nPoints; ++n)
+    identity[n] = n;
+  return identity;
+}
+
 Point Surface::snap(Point p) const {
   if (_nPoints == 0) {
     throw std::runtime_error("Surface::snap: surface has no points.");
@@ -139,7 +413,8 @@ std::ostream &operator<<(std::ostream &os, const Surface &obj)
 {
   //format: 3 cols of value: x y z
   for (int i = 0; i < obj._nPoints; ++i) {
-    os << obj._data[i].x << ' ' << obj._data[i].y << ' ' << obj._data[i].z << '\n';
+    Point p = obj[i];
+    os << p.x << ' ' << p.y << ' ' << p.z << '\n';
   }
   return os;
 }
\ No newline at end of file
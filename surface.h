@@ -1,11 +1,14 @@
 #ifndef SURFACE_H
 #define SURFACE_H
 
+#include <cstdint>
 #include <vector>
 #include <ostream>
 #include <functional>
+#include <memory>
 
 #include "utils.hpp"
+#include "mapped_file.h"
 
 //to do: template class T
 class Surface {
@@ -13,11 +16,42 @@ class Surface {
   Point* _data;
   std::function<double(double,double,double)> _phi = nullptr;
   double _h = 0;
+  // When set, _data points into this read-only mapping instead of an owned buffer: copies of the Surface share it
+  std::shared_ptr<const MappedFile> _file;
+  // Packed storage (see pack()): lattice indices of each point relative to _origin, _data is then nullptr
+  std::vector<uint64_t> _lattice;
+  Point _origin{};
+  // After reorderMorton(): index in construction order of each point (empty: construction order)
+  std::vector<int> _permutation;
+
+  struct RefinementBlocks;
+  // Collects the lattice points of the domain within the band of _phi (only in `blocks`, if not null)
+  void sample(Interval x, Interval y, Interval z, bool packed, const RefinementBlocks* blocks);
+
+  void release();
+  Point unpack(uint64_t key) const {
+    constexpr uint64_t MASK = (uint64_t(1) << LATTICE_BITS) - 1;
+    return {_origin.x + int64_t(key >> 2*LATTICE_BITS)*_h,
+            _origin.y + int64_t((key >> LATTICE_BITS) & MASK)*_h,
+            _origin.z + int64_t(key & MASK)*_h};
+  };
   
  public:
   Surface(int nPoints = 0, Point data = Point{});
   Surface(int nPoints, Point* data);
 
+  // Band points already sampled from `phi` with spacing `h` (e.g. loaded from a cache, see surface_cache.h)
+  Surface(int nPoints, const Point* data, std::function<double(double, double, double)> phi, double h);
+
+  /**
+   * @brief Read-only Surface viewing nPoints band points stored in `file` at byte `offset` (8-aligned), no copy.
+   *
+   * Processes that map the same file share one physical copy of the band (see MappedFile). `permutation`, if not
+   * empty, gives the construction index of each stored point (see permutation()), for bands saved after reordering.
+   */
+  Surface(std::shared_ptr<const MappedFile> file, size_t offset, int nPoints,
+          std::function<double(double, double, double)> phi, double h, std::vector<int> permutation = {});
+
   /**
    * @brief Creates a Surface object by sampling points near the zero level set of a scalar field function.
    *
@@ -30,9 +64,23 @@ class Surface {
    * @param y Interval specifying the minimum and maximum bounds in the y-direction.
    * @param z Interval specifying the minimum and maximum bounds in the z-direction.
    * @param h Grid spacing for sampling points in the domain.
+   * @param packed Store the points as packed lattice indices (see pack()) instead of three doubles each.
    * @return Surface object containing points near the zero level set of `phi`.
    */
-  Surface(std::function<double(double, double, double)> phi, Interval x, Interval y, Interval z, double h);
+  Surface(std::function<double(double, double, double)> phi, Interval x, Interval y, Interval z, double h,
+          bool packed = false);
+
+  /**
+   * @brief The band of spacing h built from the band of `coarse`, whose spacing must be a multiple of h.
+   *
+   * Same points, in the same order, as Surface(phi, x, y, z, h, packed) with the phi of `coarse` and the domain it
+   * was built on, but phi is only evaluated in the lattice blocks within `margin` coarse cells of the coarse band
+   * instead of the whole domain. margin = 1 is exact when phi is a distance function (1-Lipschitz): a fine band
+   * point is then closer than one coarse cell to a coarse band point. Raise it for level set functions that vary
+   * faster than the distance. Building h, h/2, h/4... this way costs about as much as the finest band alone.
+   */
+  static Surface refine(const Surface& coarse, Interval x, Interval y, Interval z, double h, bool packed = false,
+                        int margin = 1);
 
   Surface(const Surface &src);            //copy constructor
   Surface(Surface &&src);			            //move constructor
@@ -40,12 +88,48 @@ class Surface {
   Surface& operator=(Surface &&src);	    //move assignment
   ~Surface();                             //destructor
 
-  int nPoints() { return _nPoints; };
-  Point operator[](int index) const { return _data[index]; };
+  int nPoints() const { return _nPoints; };
+  Point operator[](int index) const { return _data ? _data[index] : unpack(_lattice[index]); };
+  // Contiguous points, nullptr when packed: use operator[] to support both storages
+  const Point* data() const { return _data; };
+  double h() const { return _h; };
+  bool mapped() const { return _file != nullptr; };
+  bool packed() const { return !_lattice.empty(); };
+
+  // Bits of each lattice index in the packed storage: up to 2^21 lattice points along each axis
+  static constexpr int LATTICE_BITS = 21;
+
+  /**
+   * @brief Stores the points as lattice indices (i,j,k), point = origin + (i,j,k)*h, packed in one uint64 (8 bytes
+   * instead of 24).
+   *
+   * `origin` is the corner of the construction domain (x.min, y.min, z.min), so that decoding gives back exactly the
+   * coordinates computed by the implicit constructor. Returns false, leaving the storage unchanged, if a point does
+   * not round-trip exactly or an index does not fit in LATTICE_BITS. A mapped surface becomes a private packed copy.
+   */
+  bool pack(Point origin);
+
+  /**
+   * @brief Sorts the points along the Z-order (Morton) curve of their lattice coordinates.
+   *
+   * The constructor emits the band in x-major order, where neighbours on the surface are far apart in memory;
+   * in Morton order they mostly share cache lines, which speeds up neighbour lookups and the sparse operators of
+   * the band (BandIndex, HeatGeodesics). Points not on the h lattice keep their relative order at the end.
+   * A mapped surface becomes a private copy. Indices into the band (BandIndex, HeatGeodesics...) change: build them
+   * after reordering, and use permutation() to relate them to the construction order, as band density maps do.
+   */
+  void reorderMorton();
+
+  // Index in construction order of each point (the identity if the points were never reordered)
+  std::vector<int> permutation() const;
+  bool reordered() const { return !_permutation.empty(); };
 
   // Project point p onto the surface using the phi function provided at construction
   Point project(Point p) const;
 
+  // Unit normal (normalised gradient of phi) at p, zero vector where the gradient vanishes
+  Point normal(Point p) const;
+
   // Snap p to the nearest point in the surface
   Point snap(Point p) const;
 
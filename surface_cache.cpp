@@ -0,0 +1,141 @@
+#include "surface_cache.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mapped_file.h"
+#include "result_cache.h"
+
+namespace {
+  constexpr char SURFACE_MAGIC[8] = {'R','W','S','U','R','F','0','3'};
+
+  struct SurfaceFileHeader {
+    char magic[8];
+    uint64_t nPoints;
+    double h;
+    double domain[6];
+    uint64_t identityBytes;
+    uint64_t dataOffset;
+    uint64_t permutationOffset;   // 0: points in construction order
+  };
+
+  // Round-trip representation of a value in the cache key
+  std::string number(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return buffer;
+  }
+}
+
+void saveSurface(const Surface &surf, const std::string &filename, const std::string &identity,
+                 Interval x, Interval y, Interval z) {
+  SurfaceFileHeader header;
+  std::memcpy(header.magic, SURFACE_MAGIC, sizeof(SURFACE_MAGIC));
+  header.nPoints = surf.nPoints();
+  header.h = surf.h();
+  double domain[6] = {x.min, x.max, y.min, y.max, z.min, z.max};
+  std::memcpy(header.domain, domain, sizeof(domain));
+  header.identityBytes = identity.size();
+  header.dataOffset = (sizeof(header) + identity.size() + 7) / 8 * 8;
+  header.permutationOffset = surf.reordered() ? header.dataOffset + header.nPoints*sizeof(Point) : 0;
+
+  // concurrent processes building the same surface write different temporaries, the last rename wins
+  std::string tmp = filename + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(identity.data(), identity.size());
+    const char padding[8] = {};
+    out.write(padding, header.dataOffset - sizeof(header) - identity.size());
+    if (surf.data()) {
+      out.write(reinterpret_cast<const char*>(surf.data()), header.nPoints*sizeof(Point));
+    } else {
+      // packed surface: decode in blocks
+      std::vector<Point> block;
+      for (int first = 0; first < surf.nPoints(); first += 1 << 16) {
+        block.clear();
+        for (int n = first; n < std::min(surf.nPoints(), first + (1 << 16)); ++n)
+          block.push_back(surf[n]);
+        out.write(reinterpret_cast<const char*>(block.data()), block.size()*sizeof(Point));
+      }
+    }
+    if (surf.reordered()) {
+      std::vector<int> order = surf.permutation();
+      std::vector<int32_t> permutation(order.begin(), order.end());
+      out.write(reinterpret_cast<const char*>(permutation.data()), permutation.size()*sizeof(int32_t));
+    }
+    if (!out) {
+      throw std::runtime_error("saveSurface: cannot write " + tmp + ".");
+    }
+  }
+  std::filesystem::rename(tmp, filename);
+}
+
+// The surface stored in `filename` viewed in place (no copy) if it matches all the parameters, an empty one otherwise
+static Surface loadSurface(const std::string& filename, std::function<double(double, double, double)> phi,
+                           const std::string& identity, Interval x, Interval y, Interval z, double h) {
+  std::shared_ptr<const MappedFile> file;
+  try {
+    file = std::make_shared<const MappedFile>(filename);
+  } catch (const std::runtime_error&) {
+    return Surface();
+  }
+  size_t size = file->size();
+  if (size < sizeof(SurfaceFileHeader))
+    return Surface();
+
+  const char* bytes = file->data();
+  SurfaceFileHeader header;
+  std::memcpy(&header, bytes, sizeof(header));
+  double domain[6] = {x.min, x.max, y.min, y.max, z.min, z.max};
+  bool valid = std::memcmp(header.magic, SURFACE_MAGIC, sizeof(SURFACE_MAGIC)) == 0 &&
+               header.h == h && std::memcmp(header.domain, domain, sizeof(domain)) == 0 &&
+               header.identityBytes == identity.size() &&
+               sizeof(header) + header.identityBytes <= size &&
+               std::memcmp(bytes + sizeof(header), identity.data(), identity.size()) == 0 &&
+               header.dataOffset % alignof(Point) == 0 &&
+               header.dataOffset <= size && header.nPoints <= (size - header.dataOffset) / sizeof(Point) &&
+               (header.permutationOffset == 0 ||
+                (header.permutationOffset <= size &&
+                 header.nPoints <= (size - header.permutationOffset) / sizeof(int32_t)));
+  if (!valid)
+    return Surface();
+  // the permutation is only read by band density maps: a private copy, 4 bytes per point
+  std::vector<int> permutation;
+  if (header.permutationOffset != 0) {
+    std::vector<int32_t> stored(header.nPoints);
+    std::memcpy(stored.data(), bytes + header.permutationOffset, header.nPoints*sizeof(int32_t));
+    permutation.assign(stored.begin(), stored.end());
+  }
+  return Surface(file, header.dataOffset, header.nPoints, phi, h, std::move(permutation));
+}
+
+Surface cachedSurface(std::function<double(double, double, double)> phi, const std::string &identity,
+                      Interval x, Interval y, Interval z, double h, const std::string &cacheDir,
+                      const Surface *coarse, bool morton) {
+  // the reordered band is another file, with its own identity
+  std::string key = morton ? identity + " order=morton" : identity;
+  std::string parameters = " x=[" + number(x.min) + "," + number(x.max) + "] y=[" + number(y.min) + "," +
+                           number(y.max) + "] z=[" + number(z.min) + "," + number(z.max) + "] h=" + number(h);
+  std::string filename = (std::filesystem::path(cacheDir) / ("surface_" + ResultCache::hash(key + parameters) + ".rwsurf")).string();
+
+  Surface surf = loadSurface(filename, phi, key, x, y, z, h);
+  if (surf.nPoints() > 0)
+    return surf;
+
+  surf = coarse ? Surface::refine(*coarse, x, y, z, h) : Surface(phi, x, y, z, h);
+  if (morton)
+    surf.reorderMorton();
+  std::filesystem::create_directories(cacheDir);
+  saveSurface(surf, filename, key, x, y, z);
+  // use the mapping of the new file, so that the private copy is freed and shared with the other processes
+  Surface mapped = loadSurface(filename, phi, key, x, y, z, h);
+  return mapped.nPoints() == surf.nPoints() ? std::move(mapped) : std::move(surf);
+}
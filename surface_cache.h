@@ -0,0 +1,36 @@
+#ifndef SURFACE_CACHE_H
+#define SURFACE_CACHE_H
+
+#include <functional>
+#include <string>
+
+#include "surface.h"
+
+/**
+ * @brief Surface(phi, x, y, z, h), loaded from the cache directory `cacheDir` when possible.
+ *
+ * A level set function cannot be compared, so the caller names it with `identity` (e.g. "sphere centre=(5,5,5)
+ * radius=4.5"): it must change whenever phi does. The band points are stored in
+ * `cacheDir`/surface_<hash>.rwsurf, where the hash covers the identity, the domain and h. The file is memory-mapped
+ * and its header checked against all the parameters; if it is missing or does not match, the surface is built and
+ * the file (re)written, refining `coarse` (see Surface::refine) if not null. With `morton`, the band is stored and
+ * mapped in Z-order (Surface::reorderMorton), in a file of its own, with its permutation.
+ *
+ * The returned Surface is a read-only view of the mapping: all the processes (and all the copies of the Surface)
+ * using the same file share one physical copy of the band. With `cacheDir` under /dev/shm the file is a shared
+ * memory segment that never touches the disk.
+ *
+ * File layout: 8 byte magic "RWSURF03", uint64 number of points, double h, 6 doubles (x, y, z intervals),
+ * uint64 identity length, uint64 offset of the points, uint64 offset of the permutation (0 if none), the identity,
+ * then the points (3 doubles each, 8-aligned) and the permutation (int32 construction index of each point).
+ */
+Surface cachedSurface(std::function<double(double, double, double)> phi, const std::string& identity,
+                      Interval x, Interval y, Interval z, double h, const std::string& cacheDir,
+                      const Surface* coarse = nullptr, bool morton = false);
+
+// Writes the band points of `surf` (and their permutation, if reordered) to `filename` in the format of cachedSurface
+// (temporary file, then rename)
+void saveSurface(const Surface& surf, const std::string& filename, const std::string& identity,
+                 Interval x, Interval y, Interval z);
+
+#endif  //SURFACE_CACHE_H
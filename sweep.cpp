@@ -0,0 +1,176 @@
+#include "sweep.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "surface_cache.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+SurfaceSpec surfaceSpec(const std::string &name) {
+  Interval domain = {0, 10};
+  if (name == "sphere") {
+    auto phi = [](double x, double y, double z) {
+      return std::sqrt((x-5)*(x-5) + (y-5)*(y-5) + (z-5)*(z-5)) - 4.5;
+    };
+    return {name, phi, domain, domain, domain, {9.5, 5, 5}, "sphere centre=(5,5,5) radius=4.5 domain=[0,10]^3"};
+  }
+  if (name == "torus") {
+    auto phi = [](double x, double y, double z) {
+      double ring = std::sqrt((x-5)*(x-5) + (y-5)*(y-5)) - 3;
+      return std::sqrt(ring*ring + (z-5)*(z-5)) - 1.2;
+    };
+    return {name, phi, domain, domain, domain, {9.2, 5, 5}, "torus centre=(5,5,5) radii=3,1.2 domain=[0,10]^3"};
+  }
+  throw std::invalid_argument("surfaceSpec: unknown surface '" + name + "'.");
+}
+
+std::vector<SweepJob> sweepJobs(const SweepParameters &parameters) {
+  std::vector<SweepJob> jobs;
+  for (auto const& surface : parameters.surfaces) {
+    for (double h : parameters.gridH) {
+      for (bool snap : parameters.snap) {
+        for (int nWalkers : parameters.nWalkers) {
+          for (double stepSize : parameters.stepSizes) {
+            jobs.push_back({surface, h, stepSize, snap, nWalkers, parameters.nSteps});
+          }
+        }
+      }
+    }
+  }
+  return jobs;
+}
+
+// Pulls tasks [0, n) from a shared counter on nThreads threads, until done or `stop` is set
+template <class Task>
+static void runOnThreads(int nThreads, size_t n, std::atomic<bool>& stop, std::exception_ptr& error, Task task) {
+  std::atomic<size_t> next{0};
+  std::mutex errorMutex;
+  int innerThreads = 1;
+#ifdef _OPENMP
+  innerThreads = std::max(1, omp_get_max_threads() / nThreads);
+#endif
+
+  auto worker = [&]() {
+#ifdef _OPENMP
+    omp_set_num_threads(innerThreads);
+#endif
+    for (size_t i = next++; i < n && !stop; i = next++) {
+      try {
+        task(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+          error = std::current_exception();
+        stop = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < std::min<size_t>(nThreads, n); ++t)
+    threads.emplace_back(worker);
+  for (auto& thread : threads)
+    thread.join();
+}
+
+bool runSweep(const std::vector<SweepJob> &jobs, int nThreads,
+              const std::function<void(SweepSurface&)> &prepare,
+              const std::function<bool(const SweepJob&, const SweepSurface&)> &run,
+              const std::string &surfaceCache, BandOptions band) {
+  nThreads = std::max(1, nThreads);
+
+  // distinct surfaces, and the number of jobs using each of them
+  std::map<std::pair<std::string, double>, size_t> surfaceIndex;
+  std::vector<size_t> jobSurface(jobs.size());
+  for (size_t j = 0; j < jobs.size(); ++j) {
+    auto key = std::make_pair(jobs[j].surface, jobs[j].gridH);
+    auto it = surfaceIndex.emplace(key, surfaceIndex.size()).first;
+    jobSurface[j] = it->second;
+  }
+  std::vector<SweepSurface> surfaces(surfaceIndex.size());
+  std::vector<std::atomic<size_t>> remaining(surfaceIndex.size());
+  for (size_t s : jobSurface)
+    ++remaining[s];
+
+  std::atomic<bool> stop{false};
+  std::exception_ptr error;
+
+  // build the surfaces: with band.refine, those of a same surface in one task, coarsest first
+  std::vector<std::pair<std::string, double>> keys(surfaceIndex.size());
+  for (auto const& [key, s] : surfaceIndex)
+    keys[s] = key;
+  std::vector<std::vector<size_t>> groups;
+  if (band.refine) {
+    std::map<std::string, std::vector<size_t>> bySurface;
+    for (size_t s = 0; s < keys.size(); ++s)
+      bySurface[keys[s].first].push_back(s);
+    for (auto& [name, group] : bySurface) {
+      std::sort(group.begin(), group.end(), [&](size_t a, size_t b) { return keys[a].second > keys[b].second; });
+      groups.push_back(group);
+    }
+  } else {
+    for (size_t s = 0; s < keys.size(); ++s)
+      groups.push_back({s});
+  }
+
+  runOnThreads(nThreads, groups.size(), stop, error, [&](size_t g) {
+    for (size_t s : groups[g]) {
+      SweepSurface& surface = surfaces[s];
+      surface.spec = surfaceSpec(keys[s].first);
+      surface.h = keys[s].second;
+      const SurfaceSpec& spec = surface.spec;
+
+      // the finest of the coarser bands whose h is a multiple of this one
+      const Surface* coarse = nullptr;
+      for (size_t c : groups[g]) {
+        double ratio = keys[c].second / surface.h;
+        if (c != s && surfaces[c].surface && ratio > 1.5 && std::abs(ratio - std::round(ratio)) < 1e-9*ratio)
+          coarse = surfaces[c].surface.get();
+      }
+
+      Surface surf = !surfaceCache.empty()
+          ? cachedSurface(spec.phi, spec.description, spec.x, spec.y, spec.z, surface.h, surfaceCache, coarse, band.morton)
+          : coarse ? Surface::refine(*coarse, spec.x, spec.y, spec.z, surface.h, band.packed)
+          : Surface(spec.phi, spec.x, spec.y, spec.z, surface.h, band.packed);
+      // a mapped band is shared with the other processes: packing or reordering it would make a private copy
+      if (band.packed && !surf.mapped() && !surf.pack({spec.x.min, spec.y.min, spec.z.min}))
+        throw std::runtime_error("runSweep: the band of " + spec.name + " cannot be packed.");
+      if (band.morton && !surf.reordered())
+        surf.reorderMorton();
+      surface.surface = std::make_unique<const Surface>(std::move(surf));
+      prepare(surface);
+    }
+  });
+  if (error)
+    std::rethrow_exception(error);
+
+  // longest jobs first
+  std::vector<size_t> order(jobs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].cost() > jobs[b].cost(); });
+
+  std::atomic<bool> interrupted{false};
+  runOnThreads(nThreads, jobs.size(), stop, error, [&](size_t i) {
+    size_t j = order[i];
+    size_t s = jobSurface[j];
+    if (!run(jobs[j], surfaces[s])) {
+      interrupted = true;
+      stop = true;
+    }
+    // release the surface after its last job
+    if (--remaining[s] == 0)
+      surfaces[s] = SweepSurface{};
+  });
+  if (error)
+    std::rethrow_exception(error);
+  return !interrupted;
+}
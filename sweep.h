@@ -0,0 +1,90 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "surface.h"
+#include "density_map.h"
+#include "geodesic.h"
+
+// A surface of the catalogue: level set function, sampling domain and starting point of the walkers
+struct SurfaceSpec {
+  std::string name;
+  std::function<double(double,double,double)> phi;
+  Interval x, y, z;
+  Point start;
+  std::string description;
+};
+
+// Surfaces known to the sweeps: "sphere" (radius 4.5 centred in (5,5,5)), "torus" (radii 3 and 1.2, same centre)
+SurfaceSpec surfaceSpec(const std::string& name);
+
+// One simulation of a sweep
+struct SweepJob {
+  std::string surface;
+  double gridH;
+  double stepSize;
+  bool snap;
+  int nWalkers;
+  int nSteps;
+  uint64_t seed = 0;    // 0: random
+
+  // Cost model used to order the jobs: the run time is dominated by the nSteps*nWalkers projections
+  double cost() const { return double(nSteps)*nWalkers; };
+};
+
+// Values of each parameter of a sweep, the jobs are their Cartesian product
+struct SweepParameters {
+  std::vector<std::string> surfaces = {"sphere"};
+  std::vector<double> gridH;
+  std::vector<double> stepSizes;
+  std::vector<bool> snap;
+  std::vector<int> nWalkers;
+  int nSteps = 0;
+};
+
+std::vector<SweepJob> sweepJobs(const SweepParameters& parameters);
+
+// A surface built for a sweep, with the read-only data its jobs share
+struct SweepSurface {
+  SurfaceSpec spec;
+  double h;
+  std::unique_ptr<const Surface> surface;
+  std::unique_ptr<const DensityMap> density;
+  std::unique_ptr<const GeodesicField> geodesic;
+};
+
+// Storage of the band points of the surfaces of a sweep
+struct BandOptions {
+  bool packed = false;  // packed lattice indices, a third of the memory (Surface::pack); not for cached surfaces,
+                        // whose mapping is already shared
+  bool morton = false;  // Z-order layout, for the neighbour-heavy kernels (Surface::reorderMorton); cached surfaces
+                        // are stored reordered
+  bool refine = false;  // build each band from the next coarser one of the same surface when its h is a multiple
+                        // (Surface::refine), instead of scanning the whole domain
+};
+
+/**
+ * @brief Runs the jobs of a sweep concurrently on nThreads threads.
+ *
+ * Each distinct (surface, gridH) pair is built once, in parallel (or loaded from `surfaceCache`, see
+ * cachedSurface, if not empty), and completed by `prepare` (density maps, geodesic fields...); the jobs then only read it, and a surface is released as soon as its last job is done.
+ * Jobs are started longest first (SweepJob::cost), which keeps the threads busy until the end of the sweep.
+ * OpenMP regions inside a job use omp_get_max_threads()/nThreads threads, so the cores are not oversubscribed.
+ * `band` selects the storage of the band points (see BandOptions).
+ *
+ * The first exception thrown by a job stops the scheduling of new jobs and is rethrown once the running ones end.
+ *
+ * @param run Runs a job, returns false if it was interrupted (no new job is started then).
+ * @return false if a job was interrupted.
+ */
+bool runSweep(const std::vector<SweepJob>& jobs, int nThreads,
+              const std::function<void(SweepSurface&)>& prepare,
+              const std::function<bool(const SweepJob&, const SweepSurface&)>& run,
+              const std::string& surfaceCache = "", BandOptions band = {});
+
+#endif  //SWEEP_H
@@ -0,0 +1,200 @@
+#include "text_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// below this size a file is parsed by a single thread
+static constexpr size_t PARALLEL_BYTES = 1 << 20;
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Powers of ten that are exact doubles
+static constexpr double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parses one number starting at p, returns the end of the number or nullptr if there is none
+static const char* parseDouble(const char* p, const char* last, double& value) {
+  const char* start = p;
+  bool negative = false;
+  if (p < last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  // the mantissa as an integer: with at most 15 significant digits it converts to a double exactly
+  uint64_t mantissa = 0;
+  int nDigits = 0;
+  int exponent = 0;
+  bool anyDigit = false;
+  for (; p < last && *p >= '0' && *p <= '9'; ++p) {
+    anyDigit = true;
+    if (mantissa == 0 && *p == '0')
+      continue;
+    if (nDigits < 19)
+      mantissa = 10*mantissa + (*p - '0');
+    else
+      ++exponent;
+    ++nDigits;
+  }
+  if (p < last && *p == '.') {
+    ++p;
+    for (; p < last && *p >= '0' && *p <= '9'; ++p) {
+      anyDigit = true;
+      if (mantissa == 0 && *p == '0') {
+        --exponent;
+        continue;
+      }
+      if (nDigits < 19) {
+        mantissa = 10*mantissa + (*p - '0');
+        --exponent;
+      }
+      ++nDigits;
+    }
+  }
+  if (anyDigit && p < last && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < last && (*q == '-' || *q == '+')) {
+      negativeExponent = *q == '-';
+      ++q;
+    }
+    if (q < last && *q >= '0' && *q <= '9') {
+      int e = 0;
+      for (; q < last && *q >= '0' && *q <= '9'; ++q) {
+        if (e < 100000)
+          e = 10*e + (*q - '0');
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  if (anyDigit && nDigits <= 15 && exponent >= -22 && exponent <= 22) {
+    double m = double(mantissa);
+    value = exponent >= 0 ? m*POW10[exponent] : m/POW10[-exponent];
+    if (negative)
+      value = -value;
+    return p;
+  }
+
+  // long mantissas, large exponents, nan and inf
+  const char* digits = start < last && *start == '+' ? start + 1 : start;
+  auto res = std::from_chars(digits, last, value);
+  if (res.ec == std::errc::invalid_argument)
+    return nullptr;
+  return res.ptr;
+}
+
+const char* parsePoints(const char *first, const char *last, std::vector<Point> &out) {
+  const char* p = first;
+  while (true) {
+    while (p < last && isSpace(*p))
+      ++p;
+    if (p == last)
+      return last;
+
+    Point point;
+    double* coordinates[3] = {&point.x, &point.y, &point.z};
+    for (int c = 0; c < 3; ++c) {
+      while (p < last && (*p == ' ' || *p == '\t'))
+        ++p;
+      const char* end = parseDouble(p, last, *coordinates[c]);
+      if (end == nullptr)
+        return p;
+      p = end;
+    }
+    out.push_back(point);
+  }
+}
+
+static std::vector<char> readFile(const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("readPointsText: cannot open " + filename + ".");
+  }
+  struct stat info;
+  std::vector<char> data;
+  if (fstat(fd, &info) == 0)
+    data.resize(info.st_size);
+
+  size_t size = 0;
+  while (true) {
+    if (size == data.size())
+      data.resize(2*data.size() + 4096);
+    ssize_t n = read(fd, data.data() + size, data.size() - size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      close(fd);
+      throw std::runtime_error("readPointsText: cannot read " + filename + ".");
+    }
+    if (n == 0)
+      break;
+    size += n;
+  }
+  close(fd);
+  data.resize(size);
+  return data;
+}
+
+std::vector<Point> readPointsText(const std::string &filename, bool parallel) {
+  std::vector<char> data = readFile(filename);
+  const char* first = data.data();
+  const char* last = first + data.size();
+
+  int nPieces = 1;
+#ifdef _OPENMP
+  if (parallel)
+    nPieces = omp_get_max_threads();
+#endif
+  // small files are not worth the threads
+  if (data.size() < PARALLEL_BYTES)
+    nPieces = 1;
+
+  // cut the text at the first line break after each even split
+  std::vector<const char*> bounds(nPieces + 1, last);
+  bounds[0] = first;
+  for (int i = 1; i < nPieces; ++i) {
+    const char* p = std::max(bounds[i-1], first + data.size()*i/nPieces);
+    while (p < last && *p != '\n')
+      ++p;
+    bounds[i] = p;
+  }
+
+  std::vector<std::vector<Point>> pieces(nPieces);
+  std::vector<const char*> stops(nPieces);
+  #pragma omp parallel for schedule(static, 1) if(nPieces > 1)
+  for (int i = 0; i < nPieces; ++i) {
+    pieces[i].reserve((bounds[i+1] - bounds[i]) / 24);
+    stops[i] = parsePoints(bounds[i], bounds[i+1], pieces[i]);
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < nPieces; ++i) {
+    if (stops[i] != bounds[i+1]) {
+      size_t line = 1 + std::count(first, stops[i], '\n');
+      throw std::runtime_error("readPointsText: invalid point at line " + std::to_string(line) + " of " + filename + ".");
+    }
+    total += pieces[i].size();
+  }
+  if (nPieces == 1)
+    return std::move(pieces[0]);
+
+  std::vector<Point> points;
+  points.reserve(total);
+  for (auto const& piece : pieces)
+    points.insert(points.end(), piece.begin(), piece.end());
+  return points;
+}
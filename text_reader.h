@@ -0,0 +1,30 @@
+#ifndef TEXT_READER_H
+#define TEXT_READER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * @brief Parses "x y z" lines (the format of writePointsText and Point::operator<<) from [first, last), appending
+ * the points to `out`.
+ *
+ * Numbers with at most 15 significant digits and a small exponent, which covers every value written with the
+ * default 6 digits, are converted with a single exact multiplication or division by a power of ten; anything else
+ * (more digits, nan, inf) falls back to std::from_chars. Either way the result is the correctly rounded double.
+ *
+ * @return Pointer to the first character that could not be parsed, `last` on success.
+ */
+const char* parsePoints(const char* first, const char* last, std::vector<Point>& out);
+
+/**
+ * @brief Reads a text snapshot written by writePointsText (or the old std::ofstream code).
+ *
+ * The file is read with a single read(2) loop into memory. With `parallel`, the text is split at line boundaries
+ * and the pieces are parsed concurrently by the OpenMP threads.
+ */
+std::vector<Point> readPointsText(const std::string& filename, bool parallel = false);
+
+#endif  //TEXT_READER_H
@@ -0,0 +1,100 @@
+#include "text_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static char* formatDouble(char* first, double value, TextPrecision precision) {
+  std::to_chars_result res;
+  if (precision == TextPrecision::Stream)
+    res = std::to_chars(first, first + 24, value, std::chars_format::general, 6);
+  else
+    res = std::to_chars(first, first + 24, value);
+  return res.ptr;
+}
+
+size_t formatPoints(const Point *points, size_t n, char *out, TextPrecision precision) {
+  char* p = out;
+  for (size_t i = 0; i < n; ++i) {
+    p = formatDouble(p, points[i].x, precision);
+    *p++ = ' ';
+    p = formatDouble(p, points[i].y, precision);
+    *p++ = ' ';
+    p = formatDouble(p, points[i].z, precision);
+    *p++ = '\n';
+  }
+  return p - out;
+}
+
+static void writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("writePointsText: write failed.");
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+// Buffer of each thread, kept between calls so that logging a snapshot does not allocate
+static char* chunkBuffer() {
+  thread_local std::vector<char> buffer(CHUNK_POINTS * MAX_LINE_CHARS);
+  return buffer.data();
+}
+
+void writePointsText(int fd, const Point *points, size_t n, TextPrecision precision, bool parallel) {
+  long nChunks = (n + CHUNK_POINTS - 1) / CHUNK_POINTS;
+
+  if (!parallel || nChunks < 2) {
+    char* buffer = chunkBuffer();
+    for (long c = 0; c < nChunks; ++c) {
+      size_t first = c * CHUNK_POINTS;
+      size_t count = std::min(CHUNK_POINTS, n - first);
+      writeAll(fd, buffer, formatPoints(points + first, count, buffer, precision));
+    }
+    return;
+  }
+
+  // format in parallel, write in file order. Exceptions cannot leave the parallel region: rethrow after it
+  bool failed = false;
+  #pragma omp parallel for ordered schedule(static, 1)
+  for (long c = 0; c < nChunks; ++c) {
+    char* buffer = chunkBuffer();
+    size_t first = c * CHUNK_POINTS;
+    size_t count = std::min(CHUNK_POINTS, n - first);
+    size_t bytes = formatPoints(points + first, count, buffer, precision);
+    #pragma omp ordered
+    {
+      if (!failed) {
+        try {
+          writeAll(fd, buffer, bytes);
+        } catch (const std::runtime_error&) {
+          failed = true;
+        }
+      }
+    }
+  }
+  if (failed)
+    throw std::runtime_error("writePointsText: write failed.");
+}
+
+void writePointsText(const std::string &filename, const Point *points, size_t n, TextPrecision precision, bool parallel) {
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("writePointsText: cannot open " + filename + ".");
+  }
+  try {
+    writePointsText(fd, points, n, precision, parallel);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+}
@@ -0,0 +1,48 @@
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <cstddef>
+#include <string>
+
+#include "utils.hpp"
+
+enum class TextPrecision {
+  Stream,     // same bytes as `os << point` with a default ostream (printf %g, 6 significant digits)
+  RoundTrip   // shortest representation that parses back to the same double
+};
+
+/**
+ * @brief Formats points as "x y z\n" lines into `out`, which must hold at least n*MAX_LINE_CHARS bytes.
+ *
+ * Uses std::to_chars, so the output does not depend on the locale of any stream.
+ *
+ * @return Number of bytes written.
+ */
+size_t formatPoints(const Point* points, size_t n, char* out, TextPrecision precision = TextPrecision::Stream);
+
+// upper bound on the length of a formatted line ("-1.2345678901234567e-308" three times, plus separators)
+constexpr size_t MAX_LINE_CHARS = 3*24 + 3;
+
+/**
+ * @brief Writes points in the text format of Point::operator<< (one "x y z" line per point) to a file descriptor.
+ *
+ * Points are formatted in chunks into a thread-local buffer that is reused across calls, and each chunk is
+ * flushed with a single write(2); snapshots of up to CHUNK_POINTS points take exactly one system call.
+ * With `parallel`, chunks are formatted concurrently by the OpenMP threads and written in order.
+ *
+ * @param fd File descriptor open for writing.
+ * @param points Points to write.
+ * @param n Number of points.
+ * @param precision Stream (byte compatible with the existing .dat files) or RoundTrip.
+ * @param parallel Format the chunks in parallel.
+ */
+void writePointsText(int fd, const Point* points, size_t n,
+                     TextPrecision precision = TextPrecision::Stream, bool parallel = false);
+
+// Same as above, creating (or truncating) the file `filename`
+void writePointsText(const std::string& filename, const Point* points, size_t n,
+                     TextPrecision precision = TextPrecision::Stream, bool parallel = false);
+
+constexpr size_t CHUNK_POINTS = 1 << 16;
+
+#endif  //TEXT_WRITER_H